@@ -0,0 +1,380 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    aacsyntax.c
+         Check the syntax of DAB+ AUs without decoding them
+
+    Authors:
+         agent <agent@local>
+*/
+
+/* The syntax is the one of ISO/IEC 14496-3 subpart 4, for AAC LC.
+ * The parts that are read are:
+ *
+ * raw_data_block:    id_syn_ele (3 bits) ... ID_END
+ * data_stream_element:   element_instance_tag (4), data_byte_align_flag (1),
+ *                    count (8), esc_count (8), [byte_alignment], data
+ * fill_element:      count (4), esc_count (8), data
+ * channel_pair_element:  element_instance_tag (4), common_window (1),
+ *                    [ics_info, ms_mask_present (2), ms_used]
+ * individual_channel_stream: global_gain (8), [ics_info], section_data
+ */
+
+#include "aacsyntax.h"
+
+#define ID_SCE 0
+#define ID_CPE 1
+#define ID_CCE 2
+#define ID_LFE 3
+#define ID_DSE 4
+#define ID_PCE 5
+#define ID_FIL 6
+#define ID_END 7
+
+#define EIGHT_SHORT_SEQUENCE 2
+
+#define RESERVED_HCB  12
+#define INTENSITY_HCB2 14
+#define INTENSITY_HCB  15
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;    // in bits
+    size_t pos;     // in bits
+    int overrun;
+} aac_bits_t;
+
+static unsigned aac_read(aac_bits_t* b, int n)
+{
+    unsigned value = 0;
+
+    if (b->pos + n > b->size) {
+        b->overrun = 1;
+        b->pos = b->size;
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++, b->pos++) {
+        value <<= 1;
+        value |= (b->data[b->pos / 8] >> (7 - b->pos % 8)) & 1;
+    }
+    return value;
+}
+
+static void aac_skip_bytes(aac_bits_t* b, size_t n)
+{
+    if (b->pos + 8*n > b->size) {
+        b->overrun = 1;
+        b->pos = b->size;
+    }
+    else {
+        b->pos += 8*n;
+    }
+}
+
+typedef struct {
+    int window_sequence;
+    int max_sfb;
+    int num_window_groups;
+} aac_ics_info_t;
+
+static int aac_ics_info(aac_bits_t* b, int max_long, int max_short,
+        aac_ics_info_t* ics)
+{
+    if (aac_read(b, 1) != 0) {
+        // ics_reserved_bit
+        return AAC_ERR_ICS_INFO;
+    }
+
+    ics->window_sequence = aac_read(b, 2);
+    aac_read(b, 1); // window_shape
+
+    if (ics->window_sequence == EIGHT_SHORT_SEQUENCE) {
+        ics->max_sfb = aac_read(b, 4);
+
+        // One group, and one more for each window that does not
+        // belong to the group of the previous one
+        int grouping = aac_read(b, 7);
+        ics->num_window_groups = 1;
+        for (int i = 0; i < 7; i++) {
+            if ((grouping & (1 << i)) == 0) {
+                ics->num_window_groups++;
+            }
+        }
+
+        if (ics->max_sfb > max_short) {
+            return AAC_ERR_MAX_SFB;
+        }
+    }
+    else {
+        ics->max_sfb = aac_read(b, 6);
+        ics->num_window_groups = 1;
+
+        if (ics->max_sfb > max_long) {
+            return AAC_ERR_MAX_SFB;
+        }
+
+        if (aac_read(b, 1) != 0) {
+            // predictor_data_present, not allowed in AAC LC
+            return AAC_ERR_ICS_INFO;
+        }
+    }
+
+    return b->overrun ? AAC_ERR_TRUNCATED : AAC_OK;
+}
+
+static int aac_section_data(aac_bits_t* b, const aac_ics_info_t* ics,
+        int first_channel)
+{
+    const int short_windows = ics->window_sequence == EIGHT_SHORT_SEQUENCE;
+    const int sect_bits = short_windows ? 3 : 5;
+    const unsigned sect_esc_val = (1 << sect_bits) - 1;
+
+    for (int g = 0; g < ics->num_window_groups; g++) {
+        int k = 0;
+        while (k < ics->max_sfb) {
+            unsigned sect_cb = aac_read(b, 4);
+
+            // Intensity stereo is only for the second channel of a pair
+            if (sect_cb == RESERVED_HCB || (first_channel &&
+                        (sect_cb == INTENSITY_HCB ||
+                         sect_cb == INTENSITY_HCB2))) {
+                return AAC_ERR_SECTION;
+            }
+
+            int sect_len = 0;
+            unsigned incr;
+            while ((incr = aac_read(b, sect_bits)) == sect_esc_val &&
+                    !b->overrun) {
+                sect_len += sect_esc_val;
+            }
+            sect_len += incr;
+
+            if (b->overrun) {
+                return AAC_ERR_TRUNCATED;
+            }
+
+            if (sect_len == 0 || k + sect_len > ics->max_sfb) {
+                return AAC_ERR_SECTION;
+            }
+            k += sect_len;
+        }
+    }
+
+    return AAC_OK;
+}
+
+/* Whether the byte is part of a run of fill_byte, which is 0xA5 but
+ * not necessarily byte aligned in the AU */
+static int aac_is_fill_byte(uint8_t byte)
+{
+    if (byte == 0x00) {
+        return 1;
+    }
+
+    for (int r = 0; r < 8; r++) {
+        if (((0xA5A5 >> r) & 0xFF) == byte) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Find the ID_END at the end of the AU, skipping zero padding bytes.
+ * Returns the position in bits of the ID_END, or -1 */
+static long aac_find_end(const uint8_t* au, size_t size, size_t* padding)
+{
+    size_t last = size;
+    while (last > 0 && au[last - 1] == 0) {
+        last--;
+    }
+    *padding = size - last;
+
+    if (last == 0) {
+        return -1;
+    }
+
+    // The lowest set bit is the last bit of ID_END, the byte
+    // alignment bits after it are zero
+    const uint8_t byte = au[last - 1];
+    int t = 0;
+    while ((byte & (1 << t)) == 0) {
+        t++;
+    }
+
+    const long end_bit = (long)(last - 1) * 8 + (7 - t);
+    if (end_bit < 2) {
+        return -1;
+    }
+
+    for (long pos = end_bit - 2; pos < end_bit; pos++) {
+        if (((au[pos / 8] >> (7 - pos % 8)) & 1) == 0) {
+            return -1;
+        }
+    }
+
+    return end_bit - 2;
+}
+
+/* Number of bytes before ID_END that repeat the same fill_byte value */
+static size_t aac_trailing_fill(const uint8_t* au, long end_pos)
+{
+    long i = end_pos / 8 - 1;
+    if (i < 1) {
+        return 0;
+    }
+
+    const uint8_t value = au[i];
+    if (!aac_is_fill_byte(value)) {
+        return 0;
+    }
+
+    size_t run = 0;
+    while (i >= 0 && au[i] == value) {
+        run++;
+        i--;
+    }
+
+    // A single matching byte is most likely just data
+    return run >= 2 ? run : 0;
+}
+
+int aac_validate_au(const uint8_t* au, size_t size,
+        int dac_rate, int sbr_flag, int aac_channel_mode,
+        aac_au_info_t* info)
+{
+    // Scalefactor bands of a 960 sample frame, for the AAC core sampling
+    // rates 16, 24, 32 and 48 kHz
+    static const int max_sfb_long[4]  = {42, 46, 49, 49};
+    static const int max_sfb_short[4] = {15, 15, 14, 14};
+    const int rate = (dac_rate ? 1 : 0) + (sbr_flag ? 0 : 2);
+
+    aac_bits_t bits = {au, size * 8, 0, 0};
+    aac_bits_t* b = &bits;
+
+    size_t fill_bytes = 0;
+    int ret = AAC_OK;
+
+    for (;;) {
+        const int id = aac_read(b, 3);
+
+        if (b->overrun) {
+            return AAC_ERR_TRUNCATED;
+        }
+
+        if (id == ID_DSE) {
+            aac_read(b, 4); // element_instance_tag
+            int align = aac_read(b, 1);
+            size_t count = aac_read(b, 8);
+            if (count == 255) {
+                count += aac_read(b, 8);
+            }
+            if (align) {
+                b->pos = (b->pos + 7) & ~(size_t)7;
+            }
+            aac_skip_bytes(b, count);
+        }
+        else if (id == ID_FIL) {
+            size_t count = aac_read(b, 4);
+            if (count == 15) {
+                count += aac_read(b, 8) - 1;
+            }
+            aac_skip_bytes(b, count);
+            fill_bytes += count;
+        }
+        else if (id == ID_END) {
+            return AAC_ERR_NO_AUDIO;
+        }
+        else if ((id == ID_SCE && !aac_channel_mode) ||
+                (id == ID_CPE && aac_channel_mode)) {
+            break;
+        }
+        else {
+            return AAC_ERR_ELEMENT;
+        }
+    }
+
+    aac_read(b, 4); // element_instance_tag
+
+    aac_ics_info_t ics;
+    int common_window = 0;
+
+    if (aac_channel_mode) {
+        common_window = aac_read(b, 1);
+        if (common_window) {
+            ret = aac_ics_info(b, max_sfb_long[rate], max_sfb_short[rate],
+                    &ics);
+            if (ret != AAC_OK) {
+                return ret;
+            }
+
+            int ms_mask_present = aac_read(b, 2);
+            if (ms_mask_present == 3) {
+                return AAC_ERR_MS_MASK;
+            }
+            if (ms_mask_present == 1) {
+                b->pos += ics.num_window_groups * ics.max_sfb;
+                if (b->pos > b->size) {
+                    return AAC_ERR_TRUNCATED;
+                }
+            }
+        }
+    }
+
+    aac_read(b, 8); // global_gain
+
+    if (!common_window) {
+        ret = aac_ics_info(b, max_sfb_long[rate], max_sfb_short[rate], &ics);
+        if (ret != AAC_OK) {
+            return ret;
+        }
+    }
+
+    ret = aac_section_data(b, &ics, 1);
+    if (ret != AAC_OK) {
+        return ret;
+    }
+
+    size_t padding_bytes;
+    const long end_pos = aac_find_end(au, size, &padding_bytes);
+    if (end_pos < 0 || (size_t)end_pos < b->pos) {
+        return AAC_ERR_END;
+    }
+
+    if (info) {
+        info->fill_bytes = fill_bytes + aac_trailing_fill(au, end_pos);
+        info->padding_bytes = padding_bytes;
+    }
+
+    return AAC_OK;
+}
+
+const char* aac_validate_error(int error)
+{
+    switch (error) {
+        case AAC_OK:             return "OK";
+        case AAC_ERR_TRUNCATED:  return "AU ends inside an element";
+        case AAC_ERR_ELEMENT:    return "unexpected syntactic element";
+        case AAC_ERR_NO_AUDIO:   return "no channel element";
+        case AAC_ERR_ICS_INFO:   return "invalid ics_info";
+        case AAC_ERR_MAX_SFB:    return "max_sfb too large";
+        case AAC_ERR_MS_MASK:    return "reserved ms_mask_present";
+        case AAC_ERR_SECTION:    return "invalid section data";
+        case AAC_ERR_END:        return "no ID_END at the end of the AU";
+        default:                 return "unknown error";
+    }
+}
+
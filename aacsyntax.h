@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    aacsyntax.h
+         Check the syntax of DAB+ AUs without decoding them
+
+    Authors:
+         agent <agent@local>
+*/
+
+#ifndef _AACSYNTAX_H_
+#define _AACSYNTAX_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Return values of aac_validate_au()
+#define AAC_OK              0
+#define AAC_ERR_TRUNCATED   1 // the AU ends inside an element
+#define AAC_ERR_ELEMENT     2 // unexpected element for the configuration
+#define AAC_ERR_NO_AUDIO    3 // ID_END before the channel element
+#define AAC_ERR_ICS_INFO    4 // reserved bit or prediction in ics_info
+#define AAC_ERR_MAX_SFB     5 // more scalefactor bands than the frame has
+#define AAC_ERR_MS_MASK     6 // reserved ms_mask_present
+#define AAC_ERR_SECTION     7 // invalid codebook or section length
+#define AAC_ERR_END         8 // the AU does not end with ID_END
+
+typedef struct {
+    // Fill bytes found in the AU: the FIL elements before the channel
+    // element, plus an estimate of the fill bytes before ID_END
+    size_t fill_bytes;
+
+    // Zero bytes after the ID_END
+    size_t padding_bytes;
+} aac_au_info_t;
+
+/* Check that the AU is a well-formed raw_data_block() of the AAC core
+ * of a DAB+ stream with the given parameters of the superframe header
+ * (ETSI TS 102 563, 960 samples per frame).
+ *
+ * The elements before the first channel element are parsed, and of the
+ * SCE or CPE everything up to and including the section data of the
+ * first channel. The scalefactors and spectral data that follow are
+ * Huffman coded, they would have to be decoded to find the next
+ * element. The end of the AU is checked for the ID_END, and the fill
+ * bytes in front of it are estimated from the 0xA5 or 0x00 fill_byte
+ * patterns.
+ *
+ * Returns AAC_OK or one of the AAC_ERR_* values. info can be NULL.
+ */
+int aac_validate_au(const uint8_t* au, size_t size,
+        int dac_rate, int sbr_flag, int aac_channel_mode,
+        aac_au_info_t* info);
+
+/* A description of an aac_validate_au() return value */
+const char* aac_validate_error(int error);
+
+#endif
+
@@ -0,0 +1,51 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    charset.h
+         Conversion of the DAB character sets to UTF-8
+
+    Authors:
+         agent <agent@local>
+*/
+
+#ifndef _CHARSET_H_
+#define _CHARSET_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Character sets of the FIG 1 labels (ETSI TS 101 756 table 1)
+#define CHARSET_EBU_LATIN   0x0 // complete EBU Latin based repertoire
+#define CHARSET_ISO_8859_1  0x4
+#define CHARSET_UCS2        0x6 // ISO/IEC 10646, big endian
+#define CHARSET_UTF8        0xF
+
+// Size of the buffer charset_to_utf8() needs for a label of len bytes
+#define CHARSET_UTF8_SIZE(len) (3 * (len) + 1)
+
+/* Convert a whole label of len bytes in the given character set to a NUL
+ * terminated UTF-8 string in utf8, which must have room for
+ * CHARSET_UTF8_SIZE(len) bytes. The control characters of the label
+ * are left out. Other character sets are taken as EBU Latin, which is
+ * compatible with ASCII for most printable characters.
+ *
+ * Returns the length of the UTF-8 string.
+ */
+size_t charset_to_utf8(char* utf8, const uint8_t* label, size_t len,
+        int charset);
+
+#endif
+
@@ -0,0 +1,167 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    crc.c
+         Block CRC-CCITT calculator
+
+    Authors:
+         agent <agent@local>
+*/
+
+/* Two implementations are available:
+ *
+ * - slice-by-8, which processes 8 bytes per step with eight tables.
+ *   The table crc_tab[k][b] holds the CRC of byte b followed by k zero
+ *   bytes.
+ *
+ * - carry-less multiplication (PCLMULQDQ), used for longer buffers if
+ *   the CPU supports it. The buffer is folded 16 bytes at a time into a
+ *   128-bit remainder that has the same CRC as the data consumed so
+ *   far, and the CRC of that remainder is then calculated with the
+ *   tables. See Intel's "Fast CRC Computation for Generic Polynomials
+ *   Using PCLMULQDQ Instruction".
+ */
+
+#include "crc.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define CRC_HAVE_CLMUL 1
+#  include <immintrin.h>
+#endif
+
+#define P_CCITT 0x1021
+
+static uint16_t crc_tab[8][256];
+
+#if CRC_HAVE_CLMUL
+static int crc_use_clmul;
+
+/* x^192 mod P and x^128 mod P, to fold the upper and lower 64 bits of
+ * the remainder 128 bits further */
+static uint64_t crc_fold_k1;
+static uint64_t crc_fold_k2;
+#endif
+
+/* x^n mod P */
+static uint16_t crc_xn_mod(int n)
+{
+    uint32_t r = 1;
+    for (int i = 0; i < n; i++) {
+        r <<= 1;
+        if (r & 0x10000) {
+            r ^= 0x10000 | P_CCITT;
+        }
+    }
+    return r;
+}
+
+__attribute__((constructor))
+static void crc_init(void)
+{
+    for (int b = 0; b < 256; b++) {
+        uint16_t crc = b << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ P_CCITT : (crc << 1);
+        }
+        crc_tab[0][b] = crc;
+    }
+
+    for (int k = 1; k < 8; k++) {
+        for (int b = 0; b < 256; b++) {
+            uint16_t t = crc_tab[k-1][b];
+            crc_tab[k][b] = (t << 8) ^ crc_tab[0][t >> 8];
+        }
+    }
+
+#if CRC_HAVE_CLMUL
+    __builtin_cpu_init();
+    crc_use_clmul = __builtin_cpu_supports("pclmul") &&
+                    __builtin_cpu_supports("ssse3");
+    crc_fold_k1 = crc_xn_mod(192);
+    crc_fold_k2 = crc_xn_mod(128);
+#endif
+}
+
+static uint16_t crc16_ccitt_slice8(uint16_t crc, const uint8_t* p, size_t len)
+{
+    while (len >= 8) {
+        crc = crc_tab[7][p[0] ^ (crc >> 8)] ^
+              crc_tab[6][p[1] ^ (crc & 0xFF)] ^
+              crc_tab[5][p[2]] ^
+              crc_tab[4][p[3]] ^
+              crc_tab[3][p[4]] ^
+              crc_tab[2][p[5]] ^
+              crc_tab[1][p[6]] ^
+              crc_tab[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        crc = (crc << 8) ^ crc_tab[0][(crc >> 8) ^ *p++];
+    }
+
+    return crc;
+}
+
+#if CRC_HAVE_CLMUL
+__attribute__((target("pclmul,ssse3")))
+static uint16_t crc16_ccitt_clmul(uint16_t crc, const uint8_t* p, size_t len)
+{
+    // Byte reversal, so that the first byte of the data is the most
+    // significant one, as the CRC is MSB first
+    const __m128i reverse = _mm_set_epi8(
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i k = _mm_set_epi64x(crc_fold_k1, crc_fold_k2);
+
+    // The initial register value is the same as XORing it into the
+    // first two bytes
+    __m128i rem = _mm_shuffle_epi8(
+            _mm_loadu_si128((const __m128i*)p), reverse);
+    rem = _mm_xor_si128(rem, _mm_set_epi64x((uint64_t)crc << 48, 0));
+    p += 16;
+    len -= 16;
+
+    while (len >= 16) {
+        __m128i data = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i*)p), reverse);
+        __m128i hi = _mm_clmulepi64_si128(rem, k, 0x11);
+        __m128i lo = _mm_clmulepi64_si128(rem, k, 0x00);
+        rem = _mm_xor_si128(_mm_xor_si128(hi, lo), data);
+        p += 16;
+        len -= 16;
+    }
+
+    uint8_t rem_bytes[16];
+    _mm_storeu_si128((__m128i*)rem_bytes, _mm_shuffle_epi8(rem, reverse));
+
+    crc = crc16_ccitt_slice8(0, rem_bytes, 16);
+    return crc16_ccitt_slice8(crc, p, len);
+}
+#endif
+
+uint16_t crc16_ccitt(uint16_t crc, const void* data, size_t len)
+{
+#if CRC_HAVE_CLMUL
+    if (crc_use_clmul && len >= 64) {
+        return crc16_ccitt_clmul(crc, (const uint8_t*)data, len);
+    }
+#endif
+
+    return crc16_ccitt_slice8(crc, (const uint8_t*)data, len);
+}
+
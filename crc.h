@@ -0,0 +1,39 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    crc.h
+         Block CRC-CCITT calculator
+
+    Authors:
+         agent <agent@local>
+*/
+
+#ifndef _CRC_H_
+#define _CRC_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Update the CRC-CCITT register crc (polynomial 0x1021, MSB first) with
+ * len bytes of data. The initial value and the final inversion are
+ * up to the caller, as all CRCs in ETI and DAB+ use 0xFFFF and invert:
+ *
+ *   uint16_t crc = ~crc16_ccitt(0xFFFF, data, len);
+ */
+uint16_t crc16_ccitt(uint16_t crc, const void* data, size_t len);
+
+#endif
+
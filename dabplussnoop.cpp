@@ -32,7 +32,9 @@
 #include <vector>
 #include "dabplussnoop.h"
 #include "firecode.h"
-#include "lib_crc.h"
+#include "crc.h"
+#include "rsdecoder.h"
+#include "aacsyntax.h"
 #include "faad_decoder.h"
 
 #define DPS_INDENT "\t\t"
@@ -40,64 +42,204 @@
 
 #define DPS_DEBUG 0
 
+// Maximum number of AUs in a superframe
+#define DPS_MAX_AUS 6
+
 using namespace std;
 
-void DabPlusSnoop::push(uint8_t* streamdata, size_t streamsize)
+void DabPlusSnoop::push(const uint8_t* streamdata, size_t streamsize,
+        int cif_count)
 {
-    size_t original_size = m_data.size();
-    m_data.resize(original_size + streamsize);
+    if (m_data.empty()) {
+        // set_subchannel_index() has not been called yet
+        return;
+    }
 
-    memcpy(&m_data[original_size], streamdata, streamsize);
+    const size_t capacity = m_data.size() - DPS_HEADROOM;
 
-    if (seek_valid_firecode()) {
-        // m_data now points to a valid header
-        if (decode()) {
-            // We have been able to decode the AUs
+    if (cif_count >= 0) {
+        if (cif_count % 5 == 0) {
+            // A new superframe starts here, whatever is left in the
+            // buffer could not be decoded
+            consume(data_size());
+        }
+        else if (data_size() == 0) {
+            // Wait for the start of the next superframe
+            return;
+        }
+    }
 
-            // First dump to file
-            if (m_raw_data_stream_fd == NULL) {
-                stringstream dump_filename;
-                dump_filename << "stream-" << m_index << ".dabp";
+    if (streamsize > capacity) {
+        streamdata += streamsize - capacity;
+        streamsize = capacity;
+    }
 
-                m_raw_data_stream_fd = fopen(dump_filename.str().c_str(), "w");
+    if (m_data_end + streamsize > m_data.size()) {
+        // Only happens when we cannot find or decode superframes. Move
+        // what is left to the front, dropping the oldest data if
+        // it is still too much.
+        size_t len = data_size();
+        if (len + streamsize > capacity) {
+            consume(len + streamsize - capacity);
+            len = data_size();
+        }
 
-                if (m_raw_data_stream_fd == NULL) {
-                    perror("File open failed");
+        memmove(&m_data[DPS_HEADROOM], data(), len);
+        m_data_start = DPS_HEADROOM;
+        m_data_end = DPS_HEADROOM + len;
+    }
+
+    memcpy(&m_data[m_data_end], streamdata, streamsize);
+    m_data_end += streamsize;
+
+    const size_t superframe_size = m_subchannel_index * 120;
+
+    // With the CIF count, the data starts where a superframe starts.
+    // Otherwise it starts with a FireCode found in the data, or right
+    // after the previous superframe
+    const bool candidate = (cif_count >= 0) || seek_valid_firecode();
+
+    if (candidate && superframe_size && data_size() >= superframe_size) {
+        // the data contains the whole superframe, whose header is only
+        // checked after the RS correction
+        if (correct_superframe()) {
+            m_synchronised = true;
+
+            if (decode()) {
+                // We have been able to decode the AUs
+
+                // First dump to file
+                if ((m_outputs & DPS_OUTPUT_DABP) && !m_dabp.is_open()) {
+                    bool ok;
+                    if (m_targets[0].empty()) {
+                        stringstream dump_filename;
+                        dump_filename << "stream-" << m_index << ".dabp";
+                        ok = m_dabp.open(dump_filename.str());
+                    }
+                    else {
+                        ok = m_dabp.open_target(m_targets[0]);
+                    }
+
+                    if (!ok) {
+                        perror("File open failed");
+                    }
+                }
+
+                if (m_dabp.is_open()) {
+                    m_dabp.write(data(), superframe_size);
                 }
+
+                consume(superframe_size);
+            }
+            else if (cif_count >= 0) {
+                // Wait for the next superframe
+                consume(data_size());
+            }
+            else {
+                // The header was valid, the next one follows this
+                // superframe
+                consume(superframe_size);
             }
 
-            fwrite(&m_data[0], m_subchannel_index, 120, m_raw_data_stream_fd);
+            if (m_stats_interval > 0 &&
+                    m_stats.superframes % m_stats_interval == 0) {
+                print_stats();
+            }
+        }
+        else {
+            lost_sync();
+            consume(cif_count >= 0 ? data_size() : 1);
+        }
+    }
+}
+
+void DabPlusSnoop::lost_sync()
+{
+    if (m_synchronised) {
+        m_stats.sync_losses++;
+        m_synchronised = false;
+    }
+}
 
-            m_data.erase(m_data.begin(), m_data.begin() + m_subchannel_index * 120);
+void DabPlusSnoop::set_output_target(int output, const string& target)
+{
+    // m_targets is indexed by the bit of the DPS_OUTPUT_* flag
+    for (int i = 0; i < 4; i++) {
+        if (output == (1 << i)) {
+            m_targets[i] = target;
         }
     }
+
+    m_faad_decoder.set_targets(m_targets[1], m_targets[2], m_targets[3]);
+}
+
+void DabPlusSnoop::consume(size_t len)
+{
+    m_data_start += len;
+
+    if (m_data_start >= m_data_end) {
+        m_data_start = DPS_HEADROOM;
+        m_data_end = DPS_HEADROOM;
+    }
+}
+
+// the three bytes after the firecode must not be zero
+// (simple plausibility check to avoid sync in zero byte region)
+static bool plausible_header(const uint8_t* b)
+{
+    return b[3] != 0x00 || (b[4] & 0xF0) != 0x00;
+}
+
+// Correct the superframe at the start of the data with RS, and check
+// that it starts with a superframe header
+bool DabPlusSnoop::correct_superframe()
+{
+    uint8_t* b = data();
+
+    int rs_ret = rs_decode_superframe(b, m_subchannel_index);
+
+    if (!plausible_header(b) ||
+            firecode_crc(b + 2, FIRECODE_LENGTH) != ((b[0] << 8) | b[1])) {
+#if DPS_DEBUG
+        printf(DPS_PREFIX " No valid FireCode at superframe start\n");
+#endif
+        return false;
+    }
+
+    m_stats.superframes++;
+    if (rs_ret < 0) {
+        m_stats.rs_uncorrectable++;
+    }
+    else if (rs_ret > 0) {
+        m_stats.rs_corrected++;
+        m_stats.rs_corrected_bytes += rs_ret;
+    }
+    return true;
 }
 
 // Idea and some code taken from Xpadxpert
 bool DabPlusSnoop::seek_valid_firecode()
 {
-    if (m_data.size() < 10) {
+    if (data_size() < 10) {
         // Not enough data
         return -1;
     }
 
     bool crc_ok = false;
-    size_t i;
-
-    for (i = 0; i < m_data.size() - 10; i++) {
-        uint8_t* b = &m_data[i];
+    size_t i = 0;
 
-        // the three bytes after the firecode must not be zero
-        // (simple plausibility check to avoid sync in zero byte region)
-        if (b[3] != 0x00 || (b[4] & 0xF0) != 0x00) {
-            uint16_t header_firecode = (b[0] << 8) | b[1];
-            uint16_t calculated_firecode = firecode_crc(b+2, 9);
+    for (;;) {
+        long pos = firecode_search(data(), data_size(), i);
+        if (pos < 0) {
+            break;
+        }
+        i = pos;
 
-            if (header_firecode == calculated_firecode) {
-                crc_ok = true;
-                break;
-            }
+        if (plausible_header(data() + i)) {
+            crc_ok = true;
+            break;
         }
+        i++;
     }
 
     if (crc_ok) {
@@ -105,7 +247,15 @@ bool DabPlusSnoop::seek_valid_firecode()
         printf(DPS_PREFIX " Found valid FireCode at %zu\n", i);
 #endif
 
-        m_data.erase(m_data.begin(), m_data.begin() + i);
+        if (i > 0) {
+            lost_sync();
+        }
+        consume(i);
+        return true;
+    }
+    else if (m_synchronised) {
+        // The next superframe follows the previous one. Its header can
+        // have errors, try it once the RS correction is possible
         return true;
     }
     else {
@@ -113,7 +263,8 @@ bool DabPlusSnoop::seek_valid_firecode()
         printf(DPS_PREFIX " No valid FireCode found\n");
 #endif
 
-        m_data.clear();
+        lost_sync();
+        consume(data_size());
         return false;
     }
 }
@@ -121,12 +272,12 @@ bool DabPlusSnoop::seek_valid_firecode()
 bool DabPlusSnoop::decode()
 {
 #if DPS_DEBUG
-    printf(DPS_PREFIX " We have %zu bytes of data\n", m_data.size());
+    printf(DPS_PREFIX " We have %zu bytes of data\n", data_size());
 #endif
 
-    if (m_subchannel_index && m_data.size() >= m_subchannel_index * 120) {
+    if (m_subchannel_index && data_size() >= m_subchannel_index * 120) {
 
-        uint8_t* b = &m_data[0];
+        uint8_t* b = data();
 
         // -- Parse he_aac_super_frame
         // ---- Parse he_aac_super_frame_header
@@ -140,6 +291,12 @@ bool DabPlusSnoop::decode()
         m_ps_flag                = (audio_params & 0x08) ? true : false;
         m_mpeg_surround_config   = (audio_params & 0x07);
 
+        if (m_audio_params != -1 &&
+                (m_audio_params & 0x78) != (audio_params & 0x78)) {
+            m_stats.audio_param_changes++;
+        }
+        m_audio_params = audio_params;
+
         int num_aus;
         if (!m_dac_rate && m_sbr_flag) num_aus = 2;
         // AAC core sampling rate 16 kHz
@@ -173,26 +330,12 @@ bool DabPlusSnoop::decode()
         // ------ Parse au_start
         b += 3;
 
-        vector<uint8_t> au_start_nibbles(0);
-
         /* Each AU_START is encoded in three nibbles.
-         * When we have n AUs, we have n-1 au_start values. */
-        for (int i = 0; i < (num_aus-1)*3; i++) {
-            if (i % 2 == 0) {
-                char nibble = b[i/2] >> 4;
-
-                au_start_nibbles.push_back( nibble );
-            }
-            else {
-                char nibble = b[i/2] & 0x0F;
-
-                au_start_nibbles.push_back( nibble );
-            }
-
-        }
-
-
-        vector<int> au_start(num_aus);
+         * When we have n AUs, we have n-1 au_start values.
+         * The last entry of au_start is the end of valid AU data.
+         * We stop at m_subchannel_index * 110 because what comes
+         * after is RS parity */
+        int au_start[DPS_MAX_AUS + 1];
 
         if (num_aus == 2)
             au_start[0] = 5;
@@ -203,16 +346,18 @@ bool DabPlusSnoop::decode()
         else if (num_aus == 6)
             au_start[0] = 11;
 
-
         int nib = 0;
         for (int au = 1; au < num_aus; au++) {
-            au_start[au] = au_start_nibbles[nib]   << 8 | \
-                           au_start_nibbles[nib+1] << 4 | \
-                           au_start_nibbles[nib+2];
-
-            nib += 3;
+            int value = 0;
+            for (int i = 0; i < 3; i++, nib++) {
+                value <<= 4;
+                value |= (nib % 2 == 0) ? (b[nib/2] >> 4) : (b[nib/2] & 0x0F);
+            }
+            au_start[au] = value;
         }
 
+        au_start[num_aus] = m_subchannel_index * 110;
+
 #if DPS_DEBUG
         printf(DPS_INDENT DPS_PREFIX " AU start\n");
         for (int au = 0; au < num_aus; au++) {
@@ -222,87 +367,182 @@ bool DabPlusSnoop::decode()
         }
 #endif
 
-        return extract_au(au_start);
+        return extract_au(au_start, num_aus);
     }
     else {
         return false;
     }
 }
 
-bool DabPlusSnoop::extract_au(vector<int> au_start)
+bool DabPlusSnoop::extract_au(const int* au_start, int num_aus)
 {
-    vector<vector<uint8_t> > aus(au_start.size());
-
-    // The last entry of au_start must the end of valid
-    // AU data. We stop at m_subchannel_index * 110 because
-    // what comes after is RS parity
-    au_start.push_back(m_subchannel_index * 110);
+    // The AUs are not copied out of the superframe. FaadDecoder
+    // writes the ADTS header into the ADTS_HEADER_SIZE bytes before
+    // each of them, which is why m_data has some headroom.
+    aac_au_t aus[DPS_MAX_AUS];
 
+    uint8_t* sf = data();
     bool all_crc_ok = true;
 
-    for (size_t au = 0; au < aus.size(); au++)
+    for (int au = 0; au < num_aus; au++)
+    {
+        if (au_start[au+1] - au_start[au] < 2) {
+            printf(DPS_INDENT DPS_PREFIX
+                    "Invalid AU start in superframe\n");
+            return false;
+        }
+    }
+
+    m_stats.aus += num_aus;
+
+    for (int au = 0; au < num_aus; au++)
     {
+        aus[au].data = sf + au_start[au];
+        aus[au].size = au_start[au+1] - au_start[au] - 2;
+
+        size_t bucket = aus[au].size / DPS_AU_SIZE_BUCKET;
+        if (bucket >= DPS_AU_SIZE_BUCKETS) {
+            bucket = DPS_AU_SIZE_BUCKETS - 1;
+        }
+        m_stats.au_sizes[bucket]++;
+
 #if DPS_DEBUG
         printf(DPS_PREFIX DPS_INDENT
-                "Copy au %zu of size %zu\n",
-                au,
-                au_start[au+1] - au_start[au]-2 );
+                "au %d of size %zu\n",
+                au, aus[au].size);
 #endif
 
-        aus[au].resize(au_start[au+1] - au_start[au]-2);
-        std::copy(
-                m_data.begin() + au_start[au],
-                m_data.begin() + au_start[au+1]-2,
-                aus[au].begin() );
-
         /* Check CRC */
-        uint16_t au_crc = m_data[au_start[au+1]-2] << 8 | \
-                          m_data[au_start[au+1]-1];
-
-        uint16_t calc_crc = 0xFFFF;
-        for (vector<uint8_t>::iterator au_data = aus[au].begin();
-                au_data != aus[au].end();
-                ++au_data) {
-            calc_crc = update_crc_ccitt(calc_crc, *au_data);
-        }
-        calc_crc =~ calc_crc;
+        uint16_t au_crc = aus[au].data[aus[au].size] << 8 | \
+                          aus[au].data[aus[au].size + 1];
+
+        uint16_t calc_crc = ~crc16_ccitt(0xFFFF, aus[au].data, aus[au].size);
 
         if (calc_crc != au_crc) {
             printf(DPS_INDENT DPS_PREFIX
-                    "Erroneous CRC for au %zu\n", au);
+                    "Erroneous CRC for au %d\n", au);
 
+            m_stats.au_crc_errors++;
             all_crc_ok = false;
         }
+        else if (m_validate) {
+            validate_au(au, aus[au]);
+        }
     }
 
     if (all_crc_ok) {
-        return analyse_au(aus);
+        return analyse_au(aus, num_aus);
     }
     else {
         return false;
     }
 }
 
-bool DabPlusSnoop::analyse_au(vector<vector<uint8_t> >& aus)
+void DabPlusSnoop::validate_au(int au, const aac_au_t& aac_au)
+{
+    aac_au_info_t info;
+    int ret = aac_validate_au(aac_au.data, aac_au.size,
+            m_dac_rate, m_sbr_flag, m_aac_channel_mode, &info);
+
+    if (ret == AAC_OK) {
+        m_stats.aac_valid++;
+        m_stats.aac_bytes += aac_au.size;
+        m_stats.aac_fill_bytes += info.fill_bytes;
+        m_stats.aac_padding_bytes += info.padding_bytes;
+    }
+    else {
+        printf(DPS_INDENT DPS_PREFIX
+                "Invalid AAC syntax in au %d: %s\n",
+                au, aac_validate_error(ret));
+        m_stats.aac_invalid++;
+    }
+}
+
+bool DabPlusSnoop::analyse_au(aac_au_t* aus, int num_aus)
 {
-    stringstream ss_filename;
+    const int faad_outputs = DPS_OUTPUT_AAC | DPS_OUTPUT_WAV | DPS_OUTPUT_PCM;
+    if ((m_outputs & faad_outputs) == 0) {
+        return true;
+    }
+
+    if (!m_faad_decoder.is_open()) {
+        stringstream ss_filename;
 
-    ss_filename << "stream-" << m_index;
+        ss_filename << "stream-" << m_index;
 
-    if (!m_faad_decoder.is_initialised()) {
         m_faad_decoder.open(ss_filename.str(), m_ps_flag,
                 m_aac_channel_mode, m_dac_rate, m_sbr_flag,
                 m_mpeg_surround_config);
     }
+    else {
+        m_faad_decoder.set_audio_params(m_ps_flag,
+                m_aac_channel_mode, m_dac_rate, m_sbr_flag,
+                m_mpeg_surround_config);
+    }
+
+    const int errors = m_faad_decoder.decode(aus, num_aus);
+    m_stats.faad_errors += errors;
+    return errors == 0;
+}
+
+void DabPlusSnoop::restart()
+{
+    m_data_start = DPS_HEADROOM;
+    m_data_end = DPS_HEADROOM;
+
+    m_faad_decoder.reset();
+}
+
+void DabPlusSnoop::print_stats()
+{
+    const dps_stats_t& st = m_stats;
+
+    printf(DPS_PREFIX " stream %d: %ld superframes, %ld sync losses, "
+            "%ld corrected (%ld bytes), %ld uncorrectable\n",
+            m_index, st.superframes, st.sync_losses,
+            st.rs_corrected, st.rs_corrected_bytes, st.rs_uncorrectable);
+
+    printf(DPS_PREFIX " stream %d: %ld AUs, %ld CRC errors, "
+            "%ld FAAD errors, %ld audio parameter changes\n",
+            m_index, st.aus, st.au_crc_errors, st.faad_errors,
+            st.audio_param_changes);
+
+    // Only the buckets that are used
+    stringstream sizes;
+    for (int i = 0; i < DPS_AU_SIZE_BUCKETS; i++) {
+        if (st.au_sizes[i] == 0) {
+            continue;
+        }
+
+        sizes << " " << i * DPS_AU_SIZE_BUCKET;
+        if (i < DPS_AU_SIZE_BUCKETS - 1) {
+            sizes << "-" << (i + 1) * DPS_AU_SIZE_BUCKET - 1;
+        }
+        else {
+            sizes << "+";
+        }
+        sizes << ":" << st.au_sizes[i];
+    }
 
-    return m_faad_decoder.decode(aus);
+    printf(DPS_PREFIX " stream %d: AU sizes%s\n",
+            m_index, sizes.str().c_str());
+
+    if (m_validate) {
+        printf(DPS_PREFIX " stream %d: AAC syntax: %ld valid, %ld invalid, "
+                "%ld fill bytes (%.1f%%), %ld padding bytes\n",
+                m_index, st.aac_valid, st.aac_invalid, st.aac_fill_bytes,
+                st.aac_bytes ? 100.0 * st.aac_fill_bytes / st.aac_bytes : 0.0,
+                st.aac_padding_bytes);
+    }
 }
 
 void DabPlusSnoop::close()
 {
+    if (m_stats.superframes || m_stats.sync_losses) {
+        print_stats();
+    }
+
     m_faad_decoder.close();
 
-    if (m_raw_data_stream_fd) {
-        fclose(m_raw_data_stream_fd);
-    }
+    m_dabp.close();
 }
@@ -81,6 +81,45 @@ he_aac_super_frame(subchannel_index)
 #ifndef __DABPLUSSNOOP_H_
 #define __DABPLUSSNOOP_H_
 
+// Space before the superframe in which the ADTS header
+// of the first AU is written
+#define DPS_HEADROOM ADTS_HEADER_SIZE
+
+// The files written by the decoder
+#define DPS_OUTPUT_DABP 0x1 // superframes
+#define DPS_OUTPUT_AAC  0x2 // ADTS
+#define DPS_OUTPUT_WAV  0x4 // decoded audio
+#define DPS_OUTPUT_PCM  0x8 // decoded audio without header
+
+// The default outputs
+#define DPS_OUTPUT_ALL  (DPS_OUTPUT_DABP | DPS_OUTPUT_AAC | DPS_OUTPUT_WAV)
+
+// The AU size histogram has buckets of DPS_AU_SIZE_BUCKET bytes, the
+// last one also counts all larger AUs
+#define DPS_AU_SIZE_BUCKET  64
+#define DPS_AU_SIZE_BUCKETS 16
+
+// Reception statistics of a subchannel
+struct dps_stats_t {
+    long superframes;          // superframes with a valid firecode
+    long sync_losses;          // firecode not found where expected
+    long rs_corrected;         // superframes corrected by RS
+    long rs_corrected_bytes;
+    long rs_uncorrectable;
+    long aus;                  // AUs in superframes with valid AU starts
+    long au_crc_errors;
+    long faad_errors;          // AUs libfaad could not decode
+    long audio_param_changes;  // dac_rate, sbr, ps or channel mode
+    long au_sizes[DPS_AU_SIZE_BUCKETS];
+
+    // AAC syntax checks of the AUs with a valid CRC
+    long aac_valid;
+    long aac_invalid;
+    long aac_bytes;            // size of the checked AUs
+    long aac_fill_bytes;
+    long aac_padding_bytes;
+};
+
 
 class DabPlusSnoop
 {
@@ -88,12 +127,29 @@ class DabPlusSnoop
         DabPlusSnoop() :
             m_index(0),
             m_subchannel_index(0),
+            m_outputs(DPS_OUTPUT_ALL),
             m_data(0),
-            m_raw_data_stream_fd(NULL) {}
+            m_data_start(0),
+            m_data_end(0),
+            m_stats(),
+            m_stats_interval(0),
+            m_validate(false),
+            m_synchronised(false),
+            m_audio_params(-1) {}
+
+        DabPlusSnoop(DabPlusSnoop&& other) = default;
+        DabPlusSnoop& operator=(DabPlusSnoop&& other) = default;
 
         void set_subchannel_index(unsigned subchannel_index)
         {
-            m_subchannel_index = subchannel_index;
+            if (m_subchannel_index != subchannel_index) {
+                m_subchannel_index = subchannel_index;
+
+                // Room for two superframes
+                m_data.resize(DPS_HEADROOM + 2 * subchannel_index * 120);
+                m_data_start = DPS_HEADROOM;
+                m_data_end = DPS_HEADROOM;
+            }
         }
 
         void set_index(int index)
@@ -101,11 +157,55 @@ class DabPlusSnoop
             m_index = index;
         }
 
-        void push(uint8_t* streamdata, size_t streamsize);
+        /* Select the files to write, a combination of DPS_OUTPUT_*.
+         * The firecode and AU CRCs are always checked, but libfaad is
+         * only used for DPS_OUTPUT_WAV and DPS_OUTPUT_PCM */
+        void set_outputs(int outputs)
+        {
+            m_outputs = outputs;
+            m_faad_decoder.set_outputs(outputs & DPS_OUTPUT_AAC,
+                    outputs & DPS_OUTPUT_WAV, outputs & DPS_OUTPUT_PCM);
+        }
+
+        /* Write one of the DPS_OUTPUT_* to target instead of the
+         * stream-N file, see OutputFile::open_target() */
+        void set_output_target(int output, const std::string& target);
+
+        /* Add the subchannel data of one ETI frame. cif_count is the
+         * CIF count of that frame, or -1 if it is not known. Superframes
+         * always start in a CIF whose count is a multiple of 5, which
+         * avoids searching for them byte by byte. Their FireCode is
+         * checked after the RS correction. */
+        void push(const uint8_t* streamdata, size_t streamsize,
+                int cif_count = -1);
+
+        /* Print the statistics every interval superframes,
+         * 0 to print them only when closing */
+        void set_stats_interval(int interval)
+        {
+            m_stats_interval = interval;
+        }
+
+        const dps_stats_t& stats(void) const { return m_stats; }
+
+        /* Check the AAC syntax of the AUs, see aac_validate_au() */
+        void set_validate(bool validate)
+        {
+            m_validate = validate;
+        }
+
+        void print_stats(void);
+
+        /* Drop the buffered data and restart the audio decoder, for
+         * when the subchannel of the service changes */
+        void restart(void);
 
         void close(void);
 
     private:
+        DabPlusSnoop(const DabPlusSnoop& other);
+        DabPlusSnoop& operator=(const DabPlusSnoop& other);
+
         /* Data needed for FAAD */
         FaadDecoder m_faad_decoder;
         int  m_index;
@@ -118,14 +218,43 @@ class DabPlusSnoop
 
         /* Functions */
         bool seek_valid_firecode(void);
+        bool correct_superframe(void);
         bool decode(void);
-        bool extract_au(std::vector<int> au_start);
-        bool analyse_au(std::vector<std::vector<uint8_t> >& aus);
+        bool extract_au(const int* au_start, int num_aus);
+        bool analyse_au(aac_au_t* aus, int num_aus);
+        void validate_au(int au, const aac_au_t& aac_au);
 
         unsigned m_subchannel_index;
+        int m_outputs;
+
+        /* Superframe assembly buffer, allocated once when the subchannel
+         * size is known. The valid data is m_data[m_data_start,m_data_end),
+         * and always starts at DPS_HEADROOM again once it has all been
+         * consumed. */
         std::vector<uint8_t> m_data;
+        size_t m_data_start;
+        size_t m_data_end;
+
+        uint8_t* data(void) { return &m_data[m_data_start]; }
+        size_t data_size(void) const { return m_data_end - m_data_start; }
+        void consume(size_t len);
+
+        dps_stats_t m_stats;
+        int m_stats_interval;
+        bool m_validate;
+
+        /* Whether the last superframe was found where it was expected,
+         * to count the sync losses */
+        bool m_synchronised;
+        void lost_sync(void);
+
+        /* Audio parameters of the last superframe, -1 before the first */
+        int m_audio_params;
+
+        /* The .dabp file, the superframes after RS correction */
+        OutputFile m_dabp;
 
-        FILE* m_raw_data_stream_fd;
+        std::string m_targets[4];
 };
 
 #endif
@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    decoderthread.cpp
+         Run a DAB+ decoder in its own thread
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "decoderthread.h"
+
+DabPlusDecoderThread::DabPlusDecoderThread(int index, int outputs,
+        int stats_interval, bool validate) :
+    m_slots(queue_size),
+    m_read(0),
+    m_write(0),
+    m_closing(false),
+    m_reader_waiting(false),
+    m_writer_waiting(false)
+{
+    m_snoop.set_index(index);
+    m_snoop.set_outputs(outputs);
+    m_snoop.set_stats_interval(stats_interval);
+    m_snoop.set_validate(validate);
+    m_thread = std::thread(&DabPlusDecoderThread::run, this);
+}
+
+DabPlusDecoderThread::~DabPlusDecoderThread()
+{
+    if (m_thread.joinable()) {
+        close();
+    }
+}
+
+/* The flag is set before the queue positions are checked again, and
+ * the other side updates its position before it reads the flag. With
+ * sequentially consistent atomics, at least one of them sees the
+ * other's write, so a wake-up cannot get lost. */
+void DabPlusDecoderThread::wait(std::atomic<bool>& waiting, bool for_data)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    waiting = true;
+
+    if (for_data) {
+        m_cond.wait(lock, [this] {
+                return m_write != m_read || m_closing; });
+    }
+    else {
+        m_cond.wait(lock, [this] {
+                return m_write - m_read < queue_size; });
+    }
+
+    waiting = false;
+}
+
+void DabPlusDecoderThread::wake(std::atomic<bool>& waiting)
+{
+    if (waiting) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cond.notify_all();
+    }
+}
+
+void DabPlusDecoderThread::push(const uint8_t* streamdata, size_t streamsize,
+        unsigned subchannel_index, int cif_count)
+{
+    const size_t write = m_write.load(std::memory_order_relaxed);
+
+    if (write - m_read >= queue_size) {
+        wait(m_writer_waiting, false);
+    }
+
+    slot_t& slot = m_slots[write % queue_size];
+    slot.size = std::min(streamsize, sizeof(slot.data));
+    slot.subchannel_index = subchannel_index;
+    slot.cif_count = cif_count;
+    memcpy(slot.data, streamdata, slot.size);
+
+    m_write = write + 1;
+    wake(m_reader_waiting);
+}
+
+void DabPlusDecoderThread::run()
+{
+    for (;;) {
+        const size_t read = m_read.load(std::memory_order_relaxed);
+
+        // Check m_closing before m_write, so that no data pushed
+        // before close() is missed
+        const bool closing = m_closing;
+
+        if (read == m_write) {
+            if (closing) {
+                break;
+            }
+
+            wait(m_reader_waiting, true);
+            continue;
+        }
+
+        slot_t& slot = m_slots[read % queue_size];
+        m_snoop.set_subchannel_index(slot.subchannel_index);
+        m_snoop.push(slot.data, slot.size, slot.cif_count);
+
+        m_read = read + 1;
+        wake(m_writer_waiting);
+    }
+
+    m_snoop.close();
+}
+
+void DabPlusDecoderThread::close()
+{
+    m_closing = true;
+    wake(m_reader_waiting);
+
+    m_thread.join();
+}
+
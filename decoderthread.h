@@ -0,0 +1,94 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    decoderthread.h
+         Run a DAB+ decoder in its own thread
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "dabplussnoop.h"
+
+#ifndef __DECODERTHREAD_H_
+#define __DECODERTHREAD_H_
+
+/* Decodes one subchannel with a DabPlusSnoop in a separate thread.
+ *
+ * The thread parsing the ETI copies the stream data of each frame into
+ * a single-producer single-consumer ring of slots. The read and write
+ * positions are atomics, so no lock is taken while data flows. The
+ * mutex and condition variable are only used by a side that has to
+ * wait, because the ring is empty or full, and it sets a flag so that
+ * the other side knows it has to wake it up.
+ */
+class DabPlusDecoderThread
+{
+    public:
+        DabPlusDecoderThread(int index, int outputs, int stats_interval,
+                bool validate);
+        ~DabPlusDecoderThread();
+
+        /* Queue the data of one frame, blocks if the queue is full */
+        void push(const uint8_t* streamdata, size_t streamsize,
+                unsigned subchannel_index, int cif_count);
+
+        /* Decode what is still queued, then close the decoder and
+         * stop the thread */
+        void close(void);
+
+    private:
+        DabPlusDecoderThread(const DabPlusDecoderThread& other);
+        DabPlusDecoderThread& operator=(const DabPlusDecoderThread& other);
+
+        void run(void);
+        void wait(std::atomic<bool>& waiting, bool for_data);
+        void wake(std::atomic<bool>& waiting);
+
+        struct slot_t {
+            size_t size;
+            unsigned subchannel_index;
+            int cif_count;
+            uint8_t data[6144];
+        };
+
+        static const size_t queue_size = 32;
+
+        std::vector<slot_t> m_slots;
+
+        // Free running counters, the slot is the counter modulo queue_size
+        std::atomic<size_t> m_read;
+        std::atomic<size_t> m_write;
+        std::atomic<bool> m_closing;
+
+        std::atomic<bool> m_reader_waiting;
+        std::atomic<bool> m_writer_waiting;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+
+        DabPlusSnoop m_snoop;
+        std::thread m_thread;
+};
+
+#endif
+
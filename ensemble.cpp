@@ -0,0 +1,678 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    ensemble.cpp
+         Ensemble configuration built from the FIGs
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "ensemble.h"
+#include "charset.h"
+
+using namespace std;
+
+bool ens_subchannel_t::operator==(const ens_subchannel_t& other) const
+{
+    return start_address == other.start_address &&
+        size == other.size &&
+        long_form == other.long_form &&
+        option == other.option &&
+        protection_level == other.protection_level &&
+        table_index == other.table_index;
+}
+
+string ens_subchannel_t::describe() const
+{
+    char desc[128];
+
+    if (long_form) {
+        sprintf(desc, "start %d, %d CUs, EEP %d-%c",
+                start_address, size, protection_level + 1,
+                option == 0 ? 'A' : 'B');
+    }
+    else {
+        sprintf(desc, "start %d, UEP table index %d",
+                start_address, table_index);
+    }
+    return desc;
+}
+
+bool ens_component_t::operator==(const ens_component_t& other) const
+{
+    return tmid == other.tmid &&
+        scty == other.scty &&
+        id == other.id &&
+        primary == other.primary &&
+        ca == other.ca;
+}
+
+string ens_component_t::describe() const
+{
+    char desc[128];
+
+    switch (tmid) {
+        case 0:
+            sprintf(desc, "audio ASCTy %d%s in subchannel %d",
+                    scty, scty == 63 ? " (DAB+)" : "", id);
+            break;
+        case 1:
+            sprintf(desc, "data DSCTy %d in subchannel %d", scty, id);
+            break;
+        case 2:
+            sprintf(desc, "FIDC DSCTy %d in FIDCId %d", scty, id);
+            break;
+        default:
+            sprintf(desc, "packet mode SCId %d", id);
+            break;
+    }
+
+    string s(desc);
+    if (primary) {
+        s += ", primary";
+    }
+    if (ca) {
+        s += ", CA";
+    }
+    return s;
+}
+
+static string describe_components(const vector<ens_component_t>& components)
+{
+    string s;
+    for (size_t i = 0; i < components.size(); i++) {
+        s += (i == 0) ? "" : "; ";
+        s += components[i].describe();
+    }
+    return s;
+}
+
+static string describe_label(const ens_label_t& label)
+{
+    string s = "\"" + label.text + "\"";
+    if (!label.long_text.empty()) {
+        s += " (\"" + label.long_text + "\")";
+    }
+    return s;
+}
+
+EnsembleDatabase::EnsembleDatabase() :
+    m_frame(0),
+    m_eid(-1),
+    m_change_flags(0)
+{
+    m_label.charset = -1;
+    m_label.mask = 0;
+}
+
+void EnsembleDatabase::update_frame(const EtiFrame& frame,
+        vector<string>& events)
+{
+    m_frame++;
+
+    // The CRC of each FIB is only checked once
+    int fib_ok = -1;
+    size_t fib_checked = (size_t)-1;
+
+    size_t pos = 0;
+    const uint8_t* fig;
+    while ((fig = eti_frame_next_fig(frame, &pos)) != NULL) {
+        const size_t fib = (fig - frame.fic) / 32;
+        if (fib != fib_checked) {
+            fib_checked = fib;
+            fib_ok = eti_frame_fib_crc_ok(frame, fib);
+        }
+
+        if (fib_ok) {
+            update_fig((fig[0] & 0xE0) >> 5, fig + 1, fig[0] & 0x1F,
+                    events);
+        }
+    }
+
+    // Once per second is enough to find what has disappeared
+    if (m_frame % 42 == 0) {
+        expire(events);
+    }
+}
+
+void EnsembleDatabase::update_fig(int figtype, const uint8_t* f,
+        size_t figlen, vector<string>& events)
+{
+    if (figlen < 1) {
+        return;
+    }
+
+    if (figtype == 0) {
+        const int cn = (f[0] & 0x80) >> 7;
+        const int oe = (f[0] & 0x40) >> 6;
+        const int ext = f[0] & 0x1F;
+
+        if (oe) {
+            return;
+        }
+
+        switch (ext) {
+            case 0:
+                fig0_0(f, figlen, events);
+                break;
+            case 1:
+                if (!cn) {
+                    fig0_1(f, figlen, events);
+                }
+                break;
+            case 2:
+                if (!cn) {
+                    fig0_2(f, figlen, events);
+                }
+                break;
+            case 13:
+                if (!cn) {
+                    fig0_13(f, figlen, events);
+                }
+                break;
+        }
+    }
+    else if (figtype == 1) {
+        fig1(f, figlen, events);
+    }
+    else if (figtype == 2) {
+        fig2(f, figlen, events);
+    }
+}
+
+void EnsembleDatabase::fig0_0(const uint8_t* f, size_t figlen,
+        vector<string>& events)
+{
+    char desc[128];
+
+    if (figlen < 5) {
+        return;
+    }
+
+    const int eid = (f[1] << 8) | f[2];
+    const int change_flags = (f[3] & 0xC0) >> 6;
+
+    if (eid != m_eid) {
+        sprintf(desc, "Ensemble ID 0x%04X", eid);
+        events.push_back(desc);
+        m_eid = eid;
+    }
+
+    if (change_flags != m_change_flags) {
+        if (change_flags != 0 && figlen >= 6) {
+            sprintf(desc, "Reconfiguration announced (change flags %d) "
+                    "at CIF count %d/%d", change_flags,
+                    f[3] & 0x1F, f[5]);
+            events.push_back(desc);
+        }
+        m_change_flags = change_flags;
+    }
+}
+
+void EnsembleDatabase::fig0_1(const uint8_t* f, size_t figlen,
+        vector<string>& events)
+{
+    char desc[256];
+    size_t i = 1;
+
+    while (i + 3 <= figlen) {
+        ens_subchannel_t sc = ens_subchannel_t();
+        const int subchid = f[i] >> 2;
+        sc.start_address = ((f[i] & 0x03) << 8) | f[i+1];
+        sc.long_form = f[i+2] >> 7;
+
+        if (sc.long_form) {
+            if (i + 4 > figlen) {
+                break;
+            }
+            sc.option           = (f[i+2] >> 4) & 0x07;
+            sc.protection_level = (f[i+2] >> 2) & 0x03;
+            sc.size             = ((f[i+2] & 0x03) << 8) | f[i+3];
+            i += 4;
+        }
+        else {
+            sc.table_index = f[i+2] & 0x3F;
+            i += 3;
+        }
+        sc.last_seen = m_frame;
+
+        unordered_map<int, ens_subchannel_t>::iterator it =
+            m_subchannels.find(subchid);
+
+        if (it == m_subchannels.end()) {
+            sprintf(desc, "Subchannel %d added: %s",
+                    subchid, sc.describe().c_str());
+            events.push_back(desc);
+            m_subchannels[subchid] = sc;
+        }
+        else if (!(it->second == sc)) {
+            sprintf(desc, "Subchannel %d changed: %s",
+                    subchid, sc.describe().c_str());
+            events.push_back(desc);
+            it->second = sc;
+        }
+        else {
+            it->second.last_seen = m_frame;
+        }
+    }
+}
+
+ens_service_t& EnsembleDatabase::get_service(uint32_t sid, bool data_service)
+{
+    unordered_map<uint32_t, ens_service_t>::iterator it =
+        m_services.find(sid);
+
+    if (it == m_services.end()) {
+        ens_service_t& service = m_services[sid];
+        service.sid = sid;
+        service.data_service = data_service;
+        service.local = false;
+        service.caid = 0;
+        service.label.charset = -1;
+        service.label.mask = 0;
+        service.last_seen = m_frame;
+        return service;
+    }
+
+    return it->second;
+}
+
+void EnsembleDatabase::fig0_2(const uint8_t* f, size_t figlen,
+        vector<string>& events)
+{
+    char desc[256];
+    const int pd = (f[0] & 0x20) >> 5;
+    const size_t sid_len = pd ? 4 : 2;
+    size_t k = 1;
+
+    while (k + sid_len + 1 <= figlen) {
+        uint32_t sid = 0;
+        for (size_t n = 0; n < sid_len; n++) {
+            sid = (sid << 8) | f[k + n];
+        }
+        k += sid_len;
+
+        const bool local = (f[k] & 0x80) >> 7;
+        const int caid   = (f[k] & 0x70) >> 4;
+        const int ncomp  =  f[k] & 0x0F;
+        k++;
+
+        vector<ens_component_t> components;
+        for (int c = 0; c < ncomp && k + 2 <= figlen; c++, k += 2) {
+            ens_component_t comp;
+            comp.tmid    = (f[k] & 0xC0) >> 6;
+            comp.primary = (f[k+1] & 0x02) >> 1;
+            comp.ca      =  f[k+1] & 0x01;
+            if (comp.tmid == 3) {
+                comp.scty = 0;
+                comp.id   = ((f[k] & 0x3F) << 6) | (f[k+1] >> 2);
+            }
+            else {
+                comp.scty = f[k] & 0x3F;
+                comp.id   = f[k+1] >> 2;
+            }
+            components.push_back(comp);
+        }
+
+        const bool is_new = (m_services.find(sid) == m_services.end());
+        ens_service_t& service = get_service(sid, pd);
+        service.last_seen = m_frame;
+
+        if (is_new || service.components != components) {
+            sprintf(desc, "Service 0x%04X %s: ", sid,
+                    is_new ? "added" : "components changed");
+            events.push_back(desc + describe_components(components));
+            service.components = components;
+        }
+
+        if (service.local != local || service.caid != caid) {
+            if (!is_new) {
+                sprintf(desc, "Service 0x%04X: local flag %d, CAId %d",
+                        sid, local, caid);
+                events.push_back(desc);
+            }
+            service.local = local;
+            service.caid = caid;
+        }
+    }
+}
+
+void EnsembleDatabase::fig0_13(const uint8_t* f, size_t figlen,
+        vector<string>& events)
+{
+    char desc[256];
+    const int pd = (f[0] & 0x20) >> 5;
+    const size_t sid_len = pd ? 4 : 2;
+    size_t k = 1;
+
+    while (k + sid_len + 1 <= figlen) {
+        uint32_t sid = 0;
+        for (size_t n = 0; n < sid_len; n++) {
+            sid = (sid << 8) | f[k + n];
+        }
+        k += sid_len;
+
+        const int scids = f[k] >> 4;
+        const int num   = f[k] & 0x0F;
+        k++;
+
+        vector<int> apps;
+        for (int a = 0; a < num && k + 2 <= figlen; a++) {
+            apps.push_back(((f[k] << 8) | (f[k+1] & 0xE0)) >> 5);
+            k += 2 + (f[k+1] & 0x1F);
+        }
+
+        ens_service_t& service = get_service(sid, pd);
+        vector<int>& known = service.user_apps[scids];
+
+        if (known != apps) {
+            string list;
+            for (size_t a = 0; a < apps.size(); a++) {
+                sprintf(desc, "%s%d", a == 0 ? "" : ", ", apps[a]);
+                list += desc;
+            }
+
+            sprintf(desc, "Service 0x%04X SCIdS %d user applications: ",
+                    sid, scids);
+            events.push_back(desc + list);
+            known = apps;
+        }
+    }
+}
+
+/* Read the identifier field of FIG 1 and FIG 2, after the header byte in
+ * f[0]. Returns the number of bytes of the header and identifier, or -1
+ * if the extension is not one that is kept or len is too short */
+static int ens_label_id(const uint8_t* f, size_t len, int ext,
+        uint32_t* id, int* scids)
+{
+    *scids = -1;
+
+    switch (ext) {
+        case 0: // Ensemble
+        case 1: // Programme service
+            if (len < 3) {
+                return -1;
+            }
+            *id = (f[1] << 8) | f[2];
+            return 3;
+        case 4: // Service component
+            if (len < 2) {
+                return -1;
+            }
+            *scids = f[1] & 0x0F;
+            if ((f[1] & 0x80) == 0) {
+                if (len < 4) {
+                    return -1;
+                }
+                *id = (f[2] << 8) | f[3];
+                return 4;
+            }
+            if (len < 6) {
+                return -1;
+            }
+            *id = (f[2] << 24) | (f[3] << 16) | (f[4] << 8) | f[5];
+            return 6;
+        case 5: // Data service
+            if (len < 5) {
+                return -1;
+            }
+            *id = (f[1] << 24) | (f[2] << 16) | (f[3] << 8) | f[4];
+            return 5;
+        default:
+            return -1;
+    }
+}
+
+static string ens_label_owner(int ext, uint32_t id, int scids)
+{
+    char desc[64];
+
+    if (ext == 0) {
+        return "Ensemble";
+    }
+    else if (ext == 4) {
+        sprintf(desc, "Service 0x%04X SCIdS %d", id, scids);
+    }
+    else {
+        sprintf(desc, "Service 0x%04X", id);
+    }
+    return desc;
+}
+
+ens_label_t* EnsembleDatabase::get_label(int ext, uint32_t id, int scids)
+{
+    if (ext == 0) {
+        return &m_label;
+    }
+
+    ens_service_t& service = get_service(id, ext == 5 || id > 0xFFFF);
+    if (ext == 4) {
+        return &service.component_labels[scids];
+    }
+
+    service.last_seen = m_frame;
+    return &service.label;
+}
+
+void EnsembleDatabase::fig1(const uint8_t* f, size_t figlen,
+        vector<string>& events)
+{
+    char desc[64];
+    const int charset = (f[0] & 0xF0) >> 4;
+    const int oe      = (f[0] & 0x08) >> 3;
+    const int ext     =  f[0] & 0x07;
+
+    if (oe || figlen < 19) {
+        return;
+    }
+
+    // The identifier comes before the 16 characters and the mask
+    uint32_t id;
+    int scids;
+    if (ens_label_id(f, figlen - 18, ext, &id, &scids) == -1) {
+        return;
+    }
+
+    ens_label_t* label = get_label(ext, id, scids);
+
+    const uint8_t* chars = f + figlen - 18;
+    const string raw((const char*)chars, 16);
+    const uint16_t mask = (f[figlen-2] << 8) | f[figlen-1];
+
+    if (raw != label->raw || charset != label->charset ||
+            mask != label->mask) {
+        char text[CHARSET_UTF8_SIZE(16)];
+        charset_to_utf8(text, chars, 16, charset);
+
+        label->raw = raw;
+        label->charset = charset;
+        label->mask = mask;
+        label->text = text;
+
+        sprintf(desc, "\", short label mask 0x%04X", mask);
+        events.push_back(ens_label_owner(ext, id, scids) +
+                " label: \"" + label->text + desc);
+    }
+}
+
+/* FIG 2 carries labels of up to 128 bytes in UTF-8 or UCS-2, in up to 8
+ * segments of 16 bytes. Segment 0 starts with a byte with the encoding
+ * (b7) and the number of segments minus one (b6-b4), and the 16-bit
+ * character flag field. A new label is announced with the toggle flag,
+ * the segments of the same toggle can be kept until all arrived. */
+void EnsembleDatabase::fig2(const uint8_t* f, size_t figlen,
+        vector<string>& events)
+{
+    const bool toggle  = (f[0] & 0x80) >> 7;
+    const int segment  = (f[0] & 0x70) >> 4;
+    const int oe       = (f[0] & 0x08) >> 3;
+    const int ext      =  f[0] & 0x07;
+
+    if (oe) {
+        return;
+    }
+
+    uint32_t id;
+    int scids;
+    int k = ens_label_id(f, figlen, ext, &id, &scids);
+    if (k == -1) {
+        return;
+    }
+
+    const uint64_t key = ((uint64_t)ext << 40) |
+        ((uint64_t)(scids & 0xFF) << 32) | id;
+
+    ens_fig2_label_t& fig2 = m_fig2_labels[key];
+
+    // Also true for a new entry, where everything is zero
+    if (fig2.toggle != toggle || fig2.segment_count == 0) {
+        fig2.toggle = toggle;
+        fig2.segment_count = -1;
+        fig2.charset = CHARSET_UTF8;
+        fig2.received = 0;
+        fig2.complete = false;
+        for (int i = 0; i < 8; i++) {
+            fig2.segments[i].clear();
+        }
+    }
+
+    // The repetitions of a complete label are not converted again
+    if (fig2.complete) {
+        return;
+    }
+
+    if (segment == 0) {
+        if ((size_t)k + 3 > figlen) {
+            return;
+        }
+        fig2.charset = (f[k] & 0x80) ? CHARSET_UCS2 : CHARSET_UTF8;
+        fig2.segment_count = ((f[k] & 0x70) >> 4) + 1;
+        k += 3;
+    }
+
+    fig2.segments[segment].assign((const char*)f + k, figlen - k);
+    fig2.received |= 1 << segment;
+
+    if (fig2.segment_count == -1 ||
+            fig2.received != (1 << fig2.segment_count) - 1) {
+        return;
+    }
+
+    // Convert the whole label at once, a UCS-2 character can be split
+    // over two segments
+    string raw;
+    for (int i = 0; i < fig2.segment_count; i++) {
+        raw += fig2.segments[i];
+    }
+    fig2.complete = true;
+
+    vector<char> text(CHARSET_UTF8_SIZE(raw.size()));
+    charset_to_utf8(&text[0], (const uint8_t*)raw.data(), raw.size(),
+            fig2.charset);
+
+    ens_label_t* label = get_label(ext, id, scids);
+    if (label->long_text != &text[0]) {
+        label->long_text = &text[0];
+        events.push_back(ens_label_owner(ext, id, scids) +
+                " long label: \"" + label->long_text + "\"");
+    }
+}
+
+void EnsembleDatabase::expire(vector<string>& events)
+{
+    char desc[64];
+
+    for (unordered_map<int, ens_subchannel_t>::iterator it =
+            m_subchannels.begin(); it != m_subchannels.end();) {
+        if (m_frame - it->second.last_seen > ENS_EXPIRY_FRAMES) {
+            sprintf(desc, "Subchannel %d removed", it->first);
+            events.push_back(desc);
+            it = m_subchannels.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (unordered_map<uint32_t, ens_service_t>::iterator it =
+            m_services.begin(); it != m_services.end();) {
+        if (m_frame - it->second.last_seen > ENS_EXPIRY_FRAMES) {
+            sprintf(desc, "Service 0x%04X removed", it->first);
+            events.push_back(desc);
+            it = m_services.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+const ens_subchannel_t* EnsembleDatabase::subchannel(int subchid) const
+{
+    unordered_map<int, ens_subchannel_t>::const_iterator it =
+        m_subchannels.find(subchid);
+    return it == m_subchannels.end() ? NULL : &it->second;
+}
+
+const ens_service_t* EnsembleDatabase::service(uint32_t sid) const
+{
+    unordered_map<uint32_t, ens_service_t>::const_iterator it =
+        m_services.find(sid);
+    return it == m_services.end() ? NULL : &it->second;
+}
+
+void EnsembleDatabase::print(FILE* out) const
+{
+    if (m_eid == -1) {
+        fprintf(out, "Ensemble: unknown\n");
+    }
+    else {
+        fprintf(out, "Ensemble 0x%04X %s\n", m_eid,
+                describe_label(m_label).c_str());
+    }
+
+    // Sorted, the hash maps have no useful order
+    vector<int> subchids;
+    for (unordered_map<int, ens_subchannel_t>::const_iterator it =
+            m_subchannels.begin(); it != m_subchannels.end(); ++it) {
+        subchids.push_back(it->first);
+    }
+    sort(subchids.begin(), subchids.end());
+
+    for (size_t i = 0; i < subchids.size(); i++) {
+        fprintf(out, "\tSubchannel %d: %s\n", subchids[i],
+                m_subchannels.at(subchids[i]).describe().c_str());
+    }
+
+    vector<uint32_t> sids;
+    for (unordered_map<uint32_t, ens_service_t>::const_iterator it =
+            m_services.begin(); it != m_services.end(); ++it) {
+        sids.push_back(it->first);
+    }
+    sort(sids.begin(), sids.end());
+
+    for (size_t i = 0; i < sids.size(); i++) {
+        const ens_service_t& service = m_services.at(sids[i]);
+        fprintf(out, "\tService 0x%04X %s: %s\n", service.sid,
+                describe_label(service.label).c_str(),
+                describe_components(service.components).c_str());
+    }
+}
+
@@ -0,0 +1,176 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    ensemble.h
+         Ensemble configuration built from the FIGs
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "etiframe.h"
+
+#ifndef __ENSEMBLE_H_
+#define __ENSEMBLE_H_
+
+// Entries that have not been signalled for this many frames are
+// removed, the FIC carousel repeats everything well within 10 seconds
+#define ENS_EXPIRY_FRAMES 417
+
+/* A label of FIG 1, and the long label of FIG 2. The labels are
+ * converted to UTF-8 when they change, and not for every repetition */
+struct ens_label_t {
+    std::string raw;     // the 16 bytes of FIG 1
+    int charset;
+    uint16_t mask;       // short label character flags
+    std::string text;    // in UTF-8
+    std::string long_text; // FIG 2, in UTF-8
+};
+
+// FIG 0/1
+struct ens_subchannel_t {
+    int start_address;   // in CUs
+    int size;            // in CUs, 0 if unknown (short form)
+    bool long_form;
+    int option;          // long form: 0 for EEP x-A, 1 for EEP x-B
+    int protection_level;
+    int table_index;     // short form: UEP table index
+    long last_seen;
+
+    bool operator==(const ens_subchannel_t& other) const;
+    std::string describe(void) const;
+};
+
+// A component of a service in FIG 0/2
+struct ens_component_t {
+    int tmid;
+    int scty;            // ASCTy or DSCTy, unused in packet mode
+    int id;              // SubChId, FIDCId or SCId depending on tmid
+    bool primary;
+    bool ca;
+
+    bool operator==(const ens_component_t& other) const;
+    std::string describe(void) const;
+};
+
+struct ens_service_t {
+    uint32_t sid;
+    bool data_service;   // 32-bit SId
+    bool local;
+    int caid;
+    std::vector<ens_component_t> components;
+
+    // FIG 1/1 or FIG 1/5, and FIG 2
+    ens_label_t label;
+
+    // FIG 0/13 user application types, by SCIdS
+    std::unordered_map<int, std::vector<int> > user_apps;
+
+    // FIG 1/4 and FIG 2/4 component labels, by SCIdS
+    std::unordered_map<int, ens_label_t> component_labels;
+
+    long last_seen;
+};
+
+// A FIG 2 label being reassembled from its segments
+struct ens_fig2_label_t {
+    bool toggle;
+    int segment_count;   // -1 until segment 0 was received
+    int charset;
+    uint8_t received;    // mask of the segments received
+    std::string segments[8];
+    bool complete;
+};
+
+/* The configuration of the ensemble, as signalled in FIGs 0/0, 0/1, 0/2,
+ * 0/13, 1/0, 1/1, 1/4, 1/5 and 2/x of the FIBs with a valid CRC. Only what
+ * is signalled for the current configuration of this ensemble is taken,
+ * the FIGs with the C/N flag for the next configuration or the OE flag
+ * are skipped.
+ *
+ * Every change is described with one line in the events given to
+ * update_frame(). As the FIC carousel repeats the same information all
+ * the time, most frames do not give any event.
+ */
+class EnsembleDatabase
+{
+    public:
+        EnsembleDatabase();
+
+        /* Update with all FIGs of the frame, and append a description
+         * of each change to events */
+        void update_frame(const EtiFrame& frame,
+                std::vector<std::string>& events);
+
+        /* Update with a single FIG. f points after the FIG header,
+         * figlen as in the FIG header */
+        void update_fig(int figtype, const uint8_t* f, size_t figlen,
+                std::vector<std::string>& events);
+
+        /* -1 if no FIG 0/0 was received yet */
+        int eid(void) const { return m_eid; }
+        const std::string& label(void) const { return m_label.text; }
+
+        /* NULL if not known */
+        const ens_subchannel_t* subchannel(int subchid) const;
+        const ens_service_t* service(uint32_t sid) const;
+
+        /* Print the whole configuration */
+        void print(FILE* out) const;
+
+    private:
+        void fig0_0(const uint8_t* f, size_t figlen,
+                std::vector<std::string>& events);
+        void fig0_1(const uint8_t* f, size_t figlen,
+                std::vector<std::string>& events);
+        void fig0_2(const uint8_t* f, size_t figlen,
+                std::vector<std::string>& events);
+        void fig0_13(const uint8_t* f, size_t figlen,
+                std::vector<std::string>& events);
+        void fig1(const uint8_t* f, size_t figlen,
+                std::vector<std::string>& events);
+        void fig2(const uint8_t* f, size_t figlen,
+                std::vector<std::string>& events);
+
+        /* The label of FIG 1 or FIG 2 with the extension and identifier,
+         * NULL for the extensions that are not kept */
+        ens_label_t* get_label(int ext, uint32_t id, int scids);
+
+        ens_service_t& get_service(uint32_t sid, bool data_service);
+        void expire(std::vector<std::string>& events);
+
+        // Number of frames given to update_frame()
+        long m_frame;
+
+        // FIG 0/0 and FIG 1/0
+        int m_eid;
+        int m_change_flags;
+        ens_label_t m_label;
+
+        std::unordered_map<int, ens_subchannel_t> m_subchannels;
+        std::unordered_map<uint32_t, ens_service_t> m_services;
+
+        // By extension, SCIdS and identifier
+        std::unordered_map<uint64_t, ens_fig2_label_t> m_fig2_labels;
+};
+
+#endif
+
@@ -0,0 +1,246 @@
+/*
+    Copyright (C) 2014 Matthias P. Braendli (http://www.opendigitalradio.org)
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    etiframe.cpp
+          Parse an ETI(NI) frame into its fields
+
+    Authors:
+         Matthias P. Braendli <matthias@mpb.li>
+         agent <agent@local>
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "etiframe.h"
+#include "crc.h"
+
+bool eti_parse_frame(const uint8_t* p, EtiFrame& frame)
+{
+    frame.raw = p;
+
+    // SYNC
+    frame.err   = p[0];
+    frame.fsync = (p[1] << 16) | (p[2] << 8) | p[3];
+
+    // FC
+    frame.fct  =  p[4];
+    frame.ficf = (p[5] & 0x80) >> 7;
+    frame.nst  =  p[5] & 0x7F;
+    frame.fp   = (p[6] & 0xE0) >> 5;
+    frame.mid  = (p[6] & 0x18) >> 3;
+    frame.fl   = (p[6] & 0x07) * 256 + p[7];
+
+    if (frame.nst > ETI_MAX_STREAMS) {
+        return false;
+    }
+
+    size_t ficl;
+    if (frame.ficf == 0) {
+        ficl = 0;
+    }
+    else if (frame.mid == 3) {
+        ficl = 32;
+    }
+    else {
+        ficl = 24;
+    }
+
+    // EOH
+    const uint8_t* eoh = p + 8 + 4*frame.nst;
+    frame.mnsc       = eoh[0] * 256 + eoh[1];
+    frame.header_crc = eoh[2] * 256 + eoh[3];
+
+    // MST
+    frame.mst = eoh + 4;
+    frame.fic = frame.mst;
+    frame.fic_length = ficl * 4;
+
+    // STC
+    size_t offset = frame.fic_length;
+    for (int i = 0; i < frame.nst; i++) {
+        const uint8_t* stc = p + 8 + 4*i;
+        EtiStream& stream = frame.streams[i];
+
+        stream.scid = (stc[0] & 0xFC) >> 2;
+        stream.sad  = (stc[0] & 0x03) * 256 + stc[1];
+        stream.tpl  = (stc[2] & 0xFC) >> 2;
+        stream.stl  = (stc[2] & 0x03) * 256 + stc[3];
+
+        stream.data = frame.mst + offset;
+        stream.size = stream.stl * 8;
+        offset += stream.size;
+    }
+    frame.mst_length = offset;
+
+    // EOF and TIST
+    const uint8_t* eof = frame.mst + frame.mst_length;
+    if (eof + 8 > p + 6144) {
+        return false;
+    }
+
+    frame.eof_crc = eof[0] * 256 + eof[1];
+    frame.rfu     = eof[2] * 256 + eof[3];
+    frame.tist    = (eof[4] << 24) | (eof[5] << 16) | (eof[6] << 8) | eof[7];
+
+    return true;
+}
+
+static uint16_t eti_crc(const uint8_t* data, size_t len)
+{
+    return ~crc16_ccitt(0xffff, data, len);
+}
+
+uint16_t eti_frame_header_crc(const EtiFrame& frame)
+{
+    // From FC to MNSC
+    return eti_crc(frame.raw + 4, 4 + 4*frame.nst + 2);
+}
+
+uint16_t eti_frame_eof_crc(const EtiFrame& frame)
+{
+    return eti_crc(frame.mst, frame.mst_length);
+}
+
+const uint8_t* eti_frame_next_fig(const EtiFrame& frame, size_t* pos)
+{
+    for (;;) {
+        const size_t fib = *pos - (*pos % 32);
+        const size_t i = *pos - fib;
+
+        if (fib + 32 > frame.fic_length) {
+            return NULL;
+        }
+
+        if (i < 30) {
+            const uint8_t* fig = frame.fic + *pos;
+            int figtype = (fig[0] & 0xE0) >> 5;
+            int figlen  =  fig[0] & 0x1F;
+
+            if (figtype != 7 && i + 1 + figlen <= 30) {
+                *pos += figlen + 1;
+                return fig;
+            }
+        }
+
+        // End marker or padding, continue with the next FIB
+        *pos = fib + 32;
+    }
+}
+
+bool eti_frame_fib_crc_ok(const EtiFrame& frame, size_t fib)
+{
+    const uint8_t* p = frame.fic + fib * 32;
+    return ((p[30] << 8) | p[31]) == eti_crc(p, 30);
+}
+
+int eti_frame_cif_count(const EtiFrame& frame)
+{
+    size_t pos = 0;
+    const uint8_t* fig;
+
+    while ((fig = eti_frame_next_fig(frame, &pos)) != NULL) {
+        int figtype = (fig[0] & 0xE0) >> 5;
+        int figlen  =  fig[0] & 0x1F;
+
+        if (figtype == 0 && figlen >= 5 && (fig[1] & 0x1F) == 0) {
+            int hic  = fig[4] & 0x1F;
+            int lowc = fig[5];
+            return hic * 250 + lowc;
+        }
+    }
+
+    return -1;
+}
+
+int eti_frame_stream_components(const EtiFrame& frame,
+        eti_stream_component_t* components, int max)
+{
+    int num = 0;
+    size_t pos = 0;
+    const uint8_t* fig;
+
+    while ((fig = eti_frame_next_fig(frame, &pos)) != NULL) {
+        int figtype = (fig[0] & 0xE0) >> 5;
+        int figlen  =  fig[0] & 0x1F;
+
+        if (figtype != 0 || figlen < 1 || (fig[1] & 0x1F) != 2) {
+            continue;
+        }
+
+        const int pd = (fig[1] & 0x20) >> 5;
+        const int sid_len = pd ? 4 : 2;
+        const uint8_t* f = fig + 1;
+        int k = 1;
+
+        while (k + sid_len + 1 <= figlen) {
+            uint32_t sid = 0;
+            for (int n = 0; n < sid_len; n++) {
+                sid = (sid << 8) | f[k + n];
+            }
+            k += sid_len;
+
+            const int ncomp = f[k] & 0x0F;
+            k++;
+
+            for (int c = 0; c < ncomp && k + 2 <= figlen; c++, k += 2) {
+                const int tmid = (f[k] & 0xC0) >> 6;
+
+                // Packet mode and FIDC components have no subchannel
+                if ((tmid == 0 || tmid == 1) && num < max) {
+                    eti_stream_component_t& comp = components[num++];
+                    comp.sid     = sid;
+                    comp.tmid    = tmid;
+                    comp.scty    =  f[k] & 0x3F;
+                    comp.subchid = (f[k+1] & 0xFC) >> 2;
+                    comp.primary = (f[k+1] & 0x02) >> 1;
+                }
+            }
+        }
+    }
+
+    return num;
+}
+
+void eti_cif_tracker_init(eti_cif_tracker_t* tracker)
+{
+    tracker->cif_count = -1;
+    tracker->fp = -1;
+}
+
+int eti_cif_tracker_update(eti_cif_tracker_t* tracker,
+        int frame_cif_count, int fp)
+{
+    if (frame_cif_count >= 0) {
+        tracker->cif_count = frame_cif_count;
+    }
+    else if (tracker->cif_count >= 0) {
+        int delta = 1;
+        if (tracker->fp >= 0 && fp >= 0) {
+            // FP is a modulo 8 frame counter. Some multiplexers do not
+            // increment it, assume one frame in that case.
+            delta = (fp - tracker->fp) & 0x7;
+            if (delta == 0) {
+                delta = 1;
+            }
+        }
+        tracker->cif_count = (tracker->cif_count + delta) % 5000;
+    }
+
+    tracker->fp = fp;
+    return tracker->cif_count;
+}
+
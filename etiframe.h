@@ -0,0 +1,141 @@
+/*
+    Copyright (C) 2014 Matthias P. Braendli (http://www.opendigitalradio.org)
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    etiframe.h
+          Parse an ETI(NI) frame into its fields
+
+    Authors:
+         Matthias P. Braendli <matthias@mpb.li>
+         agent <agent@local>
+*/
+
+/* The EtiFrame is a view into the frame buffer: it holds the values of
+ * the header fields, and pointers to the FIC and to the stream data.
+ * Parsing does not allocate, copy or verify CRCs. The CRCs are
+ * computed on request by the functions below.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef _ETIFRAME_H_
+#define _ETIFRAME_H_
+
+#define ETI_MAX_STREAMS 64
+
+struct EtiStream
+{
+    // STC
+    uint8_t  scid;
+    uint16_t sad;
+    uint8_t  tpl;
+    uint16_t stl;
+
+    // Stream data in the MST, stl * 8 bytes
+    const uint8_t* data;
+    size_t size;
+};
+
+struct EtiFrame
+{
+    const uint8_t* raw;
+
+    // SYNC
+    uint8_t  err;
+    uint32_t fsync;
+
+    // FC
+    uint8_t  fct;
+    uint8_t  ficf;
+    uint8_t  nst;
+    uint8_t  fp;
+    uint8_t  mid;
+    uint16_t fl;
+
+    EtiStream streams[ETI_MAX_STREAMS];
+
+    // EOH
+    uint16_t mnsc;
+    uint16_t header_crc;
+
+    // MST
+    const uint8_t* fic;
+    size_t fic_length;
+    const uint8_t* mst;
+    size_t mst_length;
+
+    // EOF
+    uint16_t eof_crc;
+    uint16_t rfu;
+
+    uint32_t tist;
+};
+
+/* Parse the frame in buf, which must be 6144 bytes long.
+ * Return false if the frame does not fit into 6144 bytes */
+bool eti_parse_frame(const uint8_t* buf, EtiFrame& frame);
+
+/* Calculate the header and EOF CRCs, to compare with the header_crc
+ * and eof_crc fields */
+uint16_t eti_frame_header_crc(const EtiFrame& frame);
+uint16_t eti_frame_eof_crc(const EtiFrame& frame);
+
+/* Return the FIG at position *pos in the FIC, or the next one if there
+ * is none at that position, and move *pos after it. Start with *pos = 0.
+ * Returns NULL after the last FIG. The FIG of the returned pointer
+ * p belongs to the FIB number (p - frame.fic) / 32. */
+const uint8_t* eti_frame_next_fig(const EtiFrame& frame, size_t* pos);
+
+/* Check the CRC of FIB number fib of the FIC */
+bool eti_frame_fib_crc_ok(const EtiFrame& frame, size_t fib);
+
+/* Return the CIF count carried in a FIG 0/0 in the FIC, or -1 if
+ * there is none */
+int eti_frame_cif_count(const EtiFrame& frame);
+
+/* A service component in stream mode, signalled in FIG 0/2 */
+struct eti_stream_component_t {
+    uint32_t sid;
+    uint8_t  tmid;    // 0 for audio, 1 for data
+    uint8_t  scty;    // ASCTy or DSCTy, 63 is DAB+ audio
+    uint8_t  subchid;
+    bool     primary;
+};
+
+/* Store the stream mode service components carried in the FIG 0/2 of
+ * the FIC into components, at most max of them, and return how many
+ * were found */
+int eti_frame_stream_components(const EtiFrame& frame,
+        eti_stream_component_t* components, int max);
+
+/* Follows the CIF count from frame to frame. Frames that carry a FIG 0/0
+ * set it, the others advance it by the difference of their frame phase
+ * FP, so that a few lost frames do not break it. */
+struct eti_cif_tracker_t {
+    int cif_count; // -1 as long as no FIG 0/0 has been seen
+    int fp;
+};
+
+void eti_cif_tracker_init(eti_cif_tracker_t* tracker);
+
+/* Return the CIF count of the next frame, given the result of
+ * eti_frame_cif_count() for it and its FP */
+int eti_cif_tracker_update(eti_cif_tracker_t* tracker,
+        int frame_cif_count, int fp);
+
+#endif
+
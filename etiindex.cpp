@@ -0,0 +1,184 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    etiindex.cpp
+          Frame index sidecar file, for random access into ETI files
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "etiindex.h"
+#include "etiinput.h"
+#include "etiframe.h"
+
+using namespace std;
+
+static uint64_t eti_file_size(FILE* etifd)
+{
+    struct stat st;
+    if (fstat(fileno(etifd), &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+static void eti_index_frame(const uint8_t* p, eti_index_entry_t& entry)
+{
+    EtiFrame frame;
+
+    entry.fct = p[4];
+    entry.flags = 0;
+    entry.tist = 0;
+    entry.cif_count = 0;
+
+    // Do not trust STL values that would make us read beyond the frame
+    if (!eti_parse_frame(p, frame)) {
+        return;
+    }
+
+    if (eti_frame_header_crc(frame) == frame.header_crc) {
+        entry.flags |= ETI_INDEX_HEADER_CRC_OK;
+    }
+
+    if (eti_frame_eof_crc(frame) == frame.eof_crc) {
+        entry.flags |= ETI_INDEX_EOF_CRC_OK;
+    }
+
+    int cif = eti_frame_cif_count(frame);
+    if (cif != -1) {
+        entry.cif_count = cif;
+        entry.flags |= ETI_INDEX_HAS_CIF_COUNT;
+    }
+
+    entry.tist = frame.tist;
+}
+
+int eti_index_build(FILE* etifd, const string& index_filename)
+{
+    struct eti_reader_t reader;
+    if (eti_reader_open(&reader, etifd) == -1) {
+        fprintf(stderr, "Could not identify stream type\n");
+        return -1;
+    }
+
+    FILE* indexfd = fopen(index_filename.c_str(), "w");
+    if (indexfd == NULL) {
+        perror("Index file open failed");
+        eti_reader_close(&reader);
+        return -1;
+    }
+
+    eti_index_header_t header;
+    memcpy(header.magic, ETI_INDEX_MAGIC, sizeof(header.magic));
+    header.stream_type = reader.stream_type;
+    header.entry_size  = sizeof(eti_index_entry_t);
+    header.file_size   = eti_file_size(etifd);
+    fwrite(&header, sizeof(header), 1, indexfd);
+
+    int ret = 0;
+    size_t num_frames = 0;
+
+    for (;;) {
+        uint8_t* p;
+        long skipped;
+        int r = eti_reader_next(&reader, &p, &skipped);
+        if (r == 0) {
+            break;
+        }
+        else if (r == -1) {
+            ret = -1;
+            break;
+        }
+
+        if (reader.frame_offset == -1) {
+            fprintf(stderr, "Cannot index a non-seekable input\n");
+            ret = -1;
+            break;
+        }
+
+        eti_index_entry_t entry;
+        entry.offset = reader.frame_offset;
+        eti_index_frame(p, entry);
+        if (skipped) {
+            entry.flags |= ETI_INDEX_RESYNC;
+        }
+
+        if (fwrite(&entry, sizeof(entry), 1, indexfd) != 1) {
+            perror("Index file write failed");
+            ret = -1;
+            break;
+        }
+        num_frames++;
+    }
+
+    eti_reader_close(&reader);
+    fclose(indexfd);
+
+    printf("Indexed %zu frames into %s\n", num_frames, index_filename.c_str());
+
+    return ret;
+}
+
+int eti_index_load(FILE* etifd, const string& index_filename,
+        vector<eti_index_entry_t>& index)
+{
+    FILE* indexfd = fopen(index_filename.c_str(), "r");
+    if (indexfd == NULL) {
+        perror("Index file open failed");
+        return -1;
+    }
+
+    eti_index_header_t header;
+    if (fread(&header, sizeof(header), 1, indexfd) != 1 ||
+            memcmp(header.magic, ETI_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+            header.entry_size != sizeof(eti_index_entry_t)) {
+        fprintf(stderr, "%s is not an ETI index\n", index_filename.c_str());
+        fclose(indexfd);
+        return -1;
+    }
+
+    if (header.file_size != eti_file_size(etifd)) {
+        fprintf(stderr, "Index %s does not match the ETI file\n",
+                index_filename.c_str());
+        fclose(indexfd);
+        return -1;
+    }
+
+    struct stat st;
+    fstat(fileno(indexfd), &st);
+    index.resize((st.st_size - sizeof(header)) / sizeof(eti_index_entry_t));
+
+    if (!index.empty() &&
+            fread(&index[0], sizeof(eti_index_entry_t), index.size(), indexfd)
+            != index.size()) {
+        perror("Index file read failed");
+        fclose(indexfd);
+        return -1;
+    }
+
+    fclose(indexfd);
+    return 0;
+}
+
@@ -0,0 +1,68 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    etiindex.h
+          Frame index sidecar file, for random access into ETI files
+
+    Authors:
+         agent <agent@local>
+*/
+
+/* The index file starts with a header, followed by one entry per
+ * frame, in file order. All fields are in host byte order.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+#ifndef _ETIINDEX_H_
+#define _ETIINDEX_H_
+
+#define ETI_INDEX_MAGIC "ETIINDX1"
+
+#define ETI_INDEX_HEADER_CRC_OK 0x01
+#define ETI_INDEX_EOF_CRC_OK    0x02
+#define ETI_INDEX_HAS_CIF_COUNT 0x04
+#define ETI_INDEX_RESYNC        0x08
+
+struct eti_index_header_t {
+    char     magic[8];
+    uint32_t stream_type;
+    uint32_t entry_size;
+    uint64_t file_size;
+} __attribute__((packed));
+
+struct eti_index_entry_t {
+    uint64_t offset;    // Offset given to eti_reader_seek to read the frame
+    uint32_t tist;
+    uint16_t cif_count; // From FIG 0/0, valid if ETI_INDEX_HAS_CIF_COUNT
+    uint8_t  fct;
+    uint8_t  flags;
+} __attribute__((packed));
+
+/* Read the whole ETI file in one pass and write the index.
+ * Return 0 on success, -1 on failure */
+int eti_index_build(FILE* etifd, const std::string& index_filename);
+
+/* Load an index written by eti_index_build, and check that it matches
+ * the ETI file. Return 0 on success, -1 on failure */
+int eti_index_load(FILE* etifd, const std::string& index_filename,
+        std::vector<eti_index_entry_t>& index);
+
+#endif
+
@@ -28,6 +28,7 @@
    along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "etiinput.h"
+#include "crc.h"
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -36,6 +37,7 @@
 #include <unistd.h>
 #include <fcntl.h>           /* Definition of AT_* constants */
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 int identify_eti_format(FILE* inputFile, int *streamType)
 {
@@ -195,3 +197,297 @@ int get_eti_frame(FILE* inputfile, int stream_type, void* buf)
     return 6144;
 }
 
+
+int eti_mmap_open(FILE* inputfile, struct eti_mmap_t* etimap)
+{
+    etimap->data = NULL;
+    etimap->size = 0;
+    etimap->pos = 0;
+    etimap->tail_start = 0;
+
+    struct stat inputFileStat;
+    if (fstat(fileno(inputfile), &inputFileStat) != 0 ||
+            !S_ISREG(inputFileStat.st_mode) ||
+            inputFileStat.st_size == 0) {
+        return -1;
+    }
+
+    long pos = ftell(inputfile);
+    if (pos < 0) {
+        return -1;
+    }
+
+    void* data = mmap(NULL, inputFileStat.st_size, PROT_READ, MAP_PRIVATE,
+            fileno(inputfile), 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    madvise(data, inputFileStat.st_size, MADV_SEQUENTIAL);
+
+    etimap->data = (uint8_t*)data;
+    etimap->size = inputFileStat.st_size;
+    etimap->pos = pos;
+    return 0;
+}
+
+int get_eti_frame_mmap(struct eti_mmap_t* etimap, int stream_type,
+        uint8_t** frame)
+{
+    size_t remaining = etimap->size - etimap->pos;
+
+    uint16_t frameSize;
+    if (stream_type == ETI_STREAM_TYPE_RAW) {
+        frameSize = 6144;
+    }
+    else {
+        if (remaining < sizeof(frameSize)) {
+            // EOF
+            return 0;
+        }
+        memcpy(&frameSize, etimap->data + etimap->pos, sizeof(frameSize));
+        etimap->pos += sizeof(frameSize);
+        remaining -= sizeof(frameSize);
+    }
+
+    if (frameSize > 6144) { // there might be a better limit
+        printf("Wrong frame size %u in ETI file!\n", frameSize);
+        return -1;
+    }
+
+    if (remaining < frameSize) {
+        if (remaining == 0 && stream_type == ETI_STREAM_TYPE_RAW) {
+            // EOF
+            return 0;
+        }
+        printf("Incomplete frame in ETI file!\n");
+        return -1;
+    }
+
+    if (remaining >= 6144) {
+        *frame = etimap->data + etimap->pos;
+    }
+    else {
+        // Not enough data after the frame to read it as 6144 bytes
+        if (etimap->tail_start == 0) {
+            etimap->tail_start = etimap->pos;
+            memset(etimap->tail, 0x55, sizeof(etimap->tail));
+            memcpy(etimap->tail, etimap->data + etimap->pos, remaining);
+        }
+        *frame = etimap->tail + (etimap->pos - etimap->tail_start);
+    }
+
+    etimap->pos += frameSize;
+
+    return 6144;
+}
+
+void eti_mmap_close(struct eti_mmap_t* etimap)
+{
+    if (etimap->data) {
+        munmap(etimap->data, etimap->size);
+        etimap->data = NULL;
+    }
+}
+
+/* Length of the FC, STC and EOH of the frame, i.e. what needs to be
+ * available to check the header CRC */
+static size_t eti_header_length(const uint8_t* buf)
+{
+    const int nst = buf[5] & 0x7F;
+    return 8 + 4*nst + 4;
+}
+
+int eti_frame_aligned(const uint8_t* buf)
+{
+    if (memcmp(buf + 1, "\x07\x3a\xb6", 3) != 0 &&
+        memcmp(buf + 1, "\xf8\xc5\x49", 3) != 0) {
+        return 0;
+    }
+
+    const size_t crc_pos = eti_header_length(buf) - 2;
+
+    const unsigned short crc = ~crc16_ccitt(0xffff, buf + 4, crc_pos - 4);
+
+    const unsigned short crch = buf[crc_pos] * 256 + buf[crc_pos + 1];
+    return crc == crch;
+}
+
+/* Return the offset of the first aligned frame in buf, starting the
+ * search at offset from, or -1 if there is none. Candidates are located
+ * with memchr(), which is vectorised in the C library, and only the ones
+ * whose header is entirely inside buf can be accepted. */
+static long eti_find_sync(const uint8_t* buf, size_t len, size_t from)
+{
+    const uint8_t* next_a = NULL;
+    const uint8_t* next_b = NULL;
+    bool more_a = true;
+    bool more_b = true;
+
+    // The FSYNC starts one byte after the beginning of the frame
+    for (size_t i = from; i + 8 <= len; ) {
+        if (more_a && (next_a == NULL || next_a < buf + i + 1)) {
+            next_a = (const uint8_t*)memchr(buf + i + 1, 0x07, len - i - 1);
+            more_a = (next_a != NULL);
+        }
+        if (more_b && (next_b == NULL || next_b < buf + i + 1)) {
+            next_b = (const uint8_t*)memchr(buf + i + 1, 0xf8, len - i - 1);
+            more_b = (next_b != NULL);
+        }
+
+        if (!more_a && !more_b) {
+            break;
+        }
+        else if (!more_b || (more_a && next_a < next_b)) {
+            i = next_a - buf - 1;
+        }
+        else {
+            i = next_b - buf - 1;
+        }
+
+        if (i + 8 <= len &&
+                i + eti_header_length(buf + i) <= len &&
+                eti_frame_aligned(buf + i)) {
+            return i;
+        }
+        i++;
+    }
+
+    return -1;
+}
+
+long eti_resync(FILE* inputfile, uint8_t* buf)
+{
+    // Largest header, with 127 streams
+    const size_t max_header = 8 + 4*127 + 4;
+
+    long skipped = 0;
+    size_t len = 6144;
+
+    size_t from = 1;
+
+    for (;;) {
+        long offset = eti_find_sync(buf, len, from);
+        if (offset >= 0) {
+            memmove(buf, buf + offset, len - offset);
+            size_t missing = 6144 - (len - offset);
+            if (fread(buf + len - offset, 1, missing, inputfile) != missing) {
+                return -1;
+            }
+            return skipped + offset;
+        }
+
+        // Keep the end of the buffer, it can contain the beginning
+        // of a frame whose header is not complete
+        memmove(buf, buf + len - max_header, max_header);
+        skipped += len - max_header;
+
+        len = max_header + fread(buf + max_header, 1, 6144 - max_header,
+                inputfile);
+        from = 0;
+        if (len == max_header) {
+            return -1;
+        }
+    }
+}
+
+long eti_mmap_resync(struct eti_mmap_t* etimap, uint8_t** frame)
+{
+    const size_t frame_pos = etimap->pos - 6144;
+
+    long offset = eti_find_sync(etimap->data + frame_pos,
+            etimap->size - frame_pos, 1);
+    if (offset <= 0) {
+        etimap->pos = etimap->size;
+        return -1;
+    }
+
+    etimap->pos = frame_pos + offset;
+    if (get_eti_frame_mmap(etimap, ETI_STREAM_TYPE_RAW, frame) != 6144) {
+        return -1;
+    }
+    return offset;
+}
+
+int eti_reader_open(struct eti_reader_t* reader, FILE* inputfile)
+{
+    reader->inputfile = inputfile;
+    reader->frame_offset = -1;
+    reader->use_mmap = 0;
+
+    if (identify_eti_format(inputfile, &reader->stream_type) == -1) {
+        return -1;
+    }
+
+    // Regular files are mapped, and the frames are read in-place
+    reader->use_mmap = (eti_mmap_open(inputfile, &reader->etimap) == 0);
+    return 0;
+}
+
+int eti_reader_next(struct eti_reader_t* reader, uint8_t** frame,
+        long* skipped)
+{
+    int ret;
+
+    *skipped = 0;
+
+    if (reader->use_mmap) {
+        reader->frame_offset = reader->etimap.pos;
+        ret = get_eti_frame_mmap(&reader->etimap, reader->stream_type, frame);
+    }
+    else {
+        reader->frame_offset = ftello(reader->inputfile);
+        ret = get_eti_frame(reader->inputfile, reader->stream_type,
+                reader->buf);
+        *frame = reader->buf;
+    }
+
+    if (ret != 6144) {
+        return ret;
+    }
+
+    // A RAW stream with dropped or inserted bytes loses the frame
+    // alignment, search for the next valid frame
+    if (reader->stream_type == ETI_STREAM_TYPE_RAW &&
+            !eti_frame_aligned(*frame)) {
+        if (reader->use_mmap) {
+            *skipped = eti_mmap_resync(&reader->etimap, frame);
+        }
+        else {
+            *skipped = eti_resync(reader->inputfile, reader->buf);
+        }
+
+        if (*skipped == -1) {
+            *skipped = 0;
+            return 0;
+        }
+
+        if (reader->frame_offset != -1) {
+            reader->frame_offset += *skipped;
+        }
+    }
+
+    return ret;
+}
+
+int eti_reader_seek(struct eti_reader_t* reader, int64_t offset)
+{
+    if (reader->use_mmap) {
+        if (offset < 0 || (uint64_t)offset > reader->etimap.size) {
+            return -1;
+        }
+        reader->etimap.pos = offset;
+        return 0;
+    }
+
+    return fseeko(reader->inputfile, offset, SEEK_SET);
+}
+
+void eti_reader_close(struct eti_reader_t* reader)
+{
+    if (reader->use_mmap) {
+        eti_mmap_close(&reader->etimap);
+        reader->use_mmap = 0;
+    }
+}
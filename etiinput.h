@@ -28,6 +28,8 @@
    along with ODR-DabMod.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
 
 #ifndef _ETIINPUT_H_
 #define _ETIINPUT_H_
@@ -45,5 +47,82 @@ int identify_eti_format(FILE* inputfile, int *stream_type);
  * Return number of bytes read, or zero if EOF */
 int get_eti_frame(FILE* inputfile, int stream_type, void* buf);
 
+/* Memory-mapped reader: the frames are handed out as pointers into
+ * the mapping, without copy and without padding.
+ *
+ * The frames of a STREAMED or FRAMED file that are less than 6144 bytes
+ * from the end of the mapping are read from the padded tail buffer
+ * instead, into which the end of the mapping gets copied once. All
+ * frame pointers stay valid until eti_mmap_close.
+ */
+struct eti_mmap_t {
+    uint8_t* data;
+    size_t   size;
+    size_t   pos;
+    size_t   tail_start;
+    uint8_t  tail[2 * 6144];
+};
+
+/* Map inputfile, starting at its current position, which must be
+ * the one left by identify_eti_format().
+ * Return 0 on success, -1 if the file cannot be mapped (e.g. a pipe) */
+int eti_mmap_open(FILE* inputfile, struct eti_mmap_t* etimap);
+
+/* Set frame to point to the next ETI frame, at least 6144 bytes long.
+ * Same return values as get_eti_frame */
+int get_eti_frame_mmap(struct eti_mmap_t* etimap, int stream_type,
+        uint8_t** frame);
+
+void eti_mmap_close(struct eti_mmap_t* etimap);
+
+/* Resynchronisation of RAW streams
+ *
+ * A frame is considered aligned if it has a valid FSYNC and a
+ * correct header CRC. When it is not, the following bytes are
+ * searched for the next aligned frame.
+ */
+
+/* Return 1 if buf starts with an aligned ETI frame, 0 otherwise */
+int eti_frame_aligned(const uint8_t* buf);
+
+/* Replace the misaligned RAW frame in buf by the next aligned one read
+ * from inputfile. Return the number of bytes skipped, or -1 if
+ * EOF was reached before a frame was found */
+long eti_resync(FILE* inputfile, uint8_t* buf);
+
+/* Same as eti_resync, for the misaligned frame last returned by
+ * get_eti_frame_mmap */
+long eti_mmap_resync(struct eti_mmap_t* etimap, uint8_t** frame);
+
+/* Frame reader combining the above: it uses the mapping if the input
+ * can be mapped, resynchronises RAW streams and keeps track of the
+ * position of each frame so that it can come back to it later.
+ */
+struct eti_reader_t {
+    FILE*    inputfile;
+    int      stream_type;
+    int      use_mmap;
+    struct eti_mmap_t etimap;
+    uint8_t  buf[6144];
+
+    /* Offset of the last frame returned, -1 if the input is not seekable */
+    int64_t  frame_offset;
+};
+
+/* Identify the stream type and prepare reading.
+ * Return 0 on success, -1 on failure */
+int eti_reader_open(struct eti_reader_t* reader, FILE* inputfile);
+
+/* Set frame to point to the next aligned ETI frame. skipped is set to
+ * the number of bytes skipped to find it.
+ * Same return values as get_eti_frame */
+int eti_reader_next(struct eti_reader_t* reader, uint8_t** frame,
+        long* skipped);
+
+/* Go to a frame_offset seen before. Return 0 on success, -1 on failure */
+int eti_reader_seek(struct eti_reader_t* reader, int64_t offset);
+
+void eti_reader_close(struct eti_reader_t* reader);
+
 #endif
 
@@ -37,10 +37,25 @@
 #include <vector>
 #include <map>
 #include <sstream>
-#include "lib_crc.h"
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "crc.h"
 
 #include "dabplussnoop.h"
 #include "etiinput.h"
+#include "etiindex.h"
+#include "etiframe.h"
+#include "decoderthread.h"
+#include "ensemble.h"
+#include "ficcarousel.h"
+#include "charset.h"
+
+// Where the analysis output goes, each thread of the parallel analysis
+// has its own
+static thread_local FILE* analysis_out;
 
 struct FIG
 {
@@ -74,47 +89,47 @@ class FIGalyser
 
         void analyse()
         {
-            printf("FIC ");
+            fprintf(analysis_out, "FIC ");
 
             for (size_t fib = 0; fib < m_figs.size(); fib++) {
                 int consumed = 7;
                 int fic_size = 0;
-                printf("[%1d ", fib);
+                fprintf(analysis_out, "[%1d ", fib);
 
                 for (size_t i = 0; i < m_figs[fib].size(); i++) {
                     FIG &f = m_figs[fib][i];
-                    printf("%01d/%02d (%2d) ", f.type, f.ext, f.len);
+                    fprintf(analysis_out, "%01d/%02d (%2d) ", f.type, f.ext, f.len);
 
                     consumed += 10;
 
                     fic_size += f.len;
                 }
 
-                printf(" ");
+                fprintf(analysis_out, " ");
 
                 int align = 60 - consumed;
                 if (align > 0) {
                     while (align--) {
-                        printf(" ");
+                        fprintf(analysis_out, " ");
                     }
                 }
 
-                printf("|");
+                fprintf(analysis_out, "|");
 
                 for (int i = 0; i < 15; i++) {
                     if (2*i < fic_size) {
-                        printf("#");
+                        fprintf(analysis_out, "#");
                     }
                     else {
-                        printf("-");
+                        fprintf(analysis_out, "-");
                     }
                 }
 
-                printf("| ]   ");
+                fprintf(analysis_out, "| ]   ");
 
             }
 
-            printf("\n");
+            fprintf(analysis_out, "\n");
         }
 
         void clear()
@@ -139,37 +154,228 @@ struct FIG0_13_shortAppInfo
 
 #define ETINIPACKETSIZE 6144
 
+// Most threads -j can start to analyse the frames
+#define MAX_ANALYSIS_THREADS 64
+
 using namespace std;
 
+/* A subchannel to decode, selected by its index in the STC with -d,
+ * or by the SId of its service with -s */
+struct decode_selection_t {
+    int stream_index; // -1 when selected by SId
+    uint32_t sid;
+    int subchid;      // -1 until resolved
+    DabPlusSnoop* dps;
+};
+
 struct eti_analyse_config_t {
     FILE* etifd;
     bool ignore_error;
-    std::map<int, DabPlusSnoop> streams_to_decode;
+    std::vector<decode_selection_t> selections;
+    bool decode_all;
+    int outputs;
+    int stats_interval; // in superframes, 0 for none
+    bool validate;
     bool analyse_fic_carousel;
+    EnsembleDatabase* ensemble; // NULL without --ensemble
+    FICCarouselAnalyser* carousel; // NULL without --carousel
+    std::vector<eti_index_entry_t> index;
+    long start_frame;
+    long end_frame;
+    int num_threads;
+
+    // The decoders of the selections, indexed by SubChId
+    DabPlusSnoop* subchannels[64];
+};
+
+/* Stream data to give to a DAB+ decoder, once the output of the frame
+ * up to text_pos has been written */
+struct stream_push_t {
+    DabPlusSnoop* dps;
+    const unsigned char* data;
+    size_t size;
+    unsigned subchannel_index;
+    long text_pos;
+};
+
+/* A frame and the result of its analysis in the parallel mode */
+struct eti_frame_analysis_t {
+    unsigned char* p;
+    long number;
+    const char* fsync_desc;
+    long skipped;
+
+    // CIF count from a FIG 0/0 in this frame or -1, and the frame phase
+    int cif_count;
+    int fp;
+
+    // The decoder for each stream of the frame, or NULL
+    DabPlusSnoop* decoders[ETI_MAX_STREAMS];
+
+    char* text;
+    size_t text_len;
+
+    int num_pushes;
+    stream_push_t pushes[64];
 };
 
 // Globals
 static int verbosity;
 
 // Function prototypes
-void printinfo(string header,
+void printinfo(const char* header,
         int indent_level,
         int min_verb=0);
 
-void printbuf(string header,
+void printbuf(const char* header,
         int indent_level,
-        unsigned char* buffer,
+        const unsigned char* buffer,
         size_t size,
-        string desc="");
+        const char* desc="");
 
-void decodeFIG(FIGalyser &figs,
-               unsigned char* figdata,
+void print_eti_header(const EtiFrame& eti);
+void print_eti_eof(const EtiFrame& eti);
+
+void decodeFIG(const unsigned char* figdata,
                unsigned char figlen,
                unsigned short int figtype,
                unsigned short int indent);
 
+int fig_extension(const unsigned char* figdata, unsigned short int figtype);
+
 int eti_analyse(eti_analyse_config_t& config);
 
+void update_selections(eti_analyse_config_t& config, const unsigned char* p,
+        DabPlusSnoop* decoders[ETI_MAX_STREAMS]);
+
+bool eti_analyse_frame(const eti_analyse_config_t& config,
+        eti_frame_analysis_t& frame,
+        bool decode,
+        eti_cif_tracker_t* cif_tracker);
+
+#define FIG_CACHE_SIZE   256 // entries, a power of two
+#define FIG_CACHE_PROBES 8
+
+/* The output of decodeFIG() for the FIGs seen recently. The FIC carousel
+ * repeats the same FIGs all the time, and only those with new content
+ * need to be decoded again, for the others the output is copied.
+ *
+ * The cache is an open addressing hash table over the FIG type and
+ * bytes. When all the slots a FIG can go to are in use, the entry
+ * repeated the least is replaced. */
+class FIGCache
+{
+    public:
+        FIGCache() :
+            m_capture(NULL),
+            m_capture_buf(NULL),
+            m_capture_len(0)
+        {
+            for (size_t i = 0; i < FIG_CACHE_SIZE; i++) {
+                m_entries[i].used = false;
+            }
+        }
+
+        ~FIGCache()
+        {
+            if (m_capture) {
+                fclose(m_capture);
+                free(m_capture_buf);
+            }
+        }
+
+        /* Write the output of decodeFIG() to analysis_out */
+        void decode(const unsigned char* f,
+                unsigned char figlen,
+                unsigned short int figtype,
+                unsigned short int indent)
+        {
+            // FIG 6 is reported on stderr
+            if (figtype == 6) {
+                decodeFIG(f, figlen, figtype, indent);
+                return;
+            }
+
+            // FNV-1a
+            uint32_t hash = 2166136261u;
+            hash = (hash ^ figtype) * 16777619u;
+            hash = (hash ^ indent) * 16777619u;
+            for (int i = 0; i < figlen; i++) {
+                hash = (hash ^ f[i]) * 16777619u;
+            }
+
+            fig_cache_entry_t* victim = NULL;
+            for (size_t n = 0; n < FIG_CACHE_PROBES; n++) {
+                fig_cache_entry_t& e =
+                    m_entries[(hash + n) & (FIG_CACHE_SIZE - 1)];
+
+                if (!e.used) {
+                    victim = &e;
+                    break;
+                }
+
+                if (e.hash == hash && e.figtype == figtype &&
+                        e.figlen == figlen && e.indent == indent &&
+                        memcmp(e.data, f, figlen) == 0) {
+                    e.repetitions++;
+                    fwrite(e.text.data(), 1, e.text.size(), analysis_out);
+                    return;
+                }
+
+                if (victim == NULL || e.repetitions < victim->repetitions) {
+                    victim = &e;
+                }
+            }
+
+            // Decode into the capture stream, and keep the output
+            if (m_capture == NULL) {
+                m_capture = open_memstream(&m_capture_buf, &m_capture_len);
+            }
+            else {
+                fseek(m_capture, 0, SEEK_SET);
+            }
+
+            FILE* out = analysis_out;
+            analysis_out = m_capture;
+            decodeFIG(f, figlen, figtype, indent);
+            analysis_out = out;
+
+            fflush(m_capture);
+            const long len = ftell(m_capture);
+            fwrite(m_capture_buf, 1, len, out);
+
+            victim->used = true;
+            victim->hash = hash;
+            victim->figtype = figtype;
+            victim->figlen = figlen;
+            victim->indent = indent;
+            memcpy(victim->data, f, figlen);
+            victim->text.assign(m_capture_buf, len);
+            victim->repetitions = 0;
+        }
+
+    private:
+        struct fig_cache_entry_t {
+            bool used;
+            uint32_t hash;
+            unsigned short int figtype;
+            unsigned char figlen;
+            unsigned short int indent;
+            unsigned char data[32];
+            std::string text;
+            unsigned long repetitions;
+        };
+
+        fig_cache_entry_t m_entries[FIG_CACHE_SIZE];
+
+        FILE* m_capture;
+        char* m_capture_buf;
+        size_t m_capture_len;
+};
+
+// Every thread of the parallel analysis has its own
+static thread_local FIGCache fig_cache;
+
 std::string get_fig_0_13_userapp(int user_app_type)
 {
     switch (user_app_type) {
@@ -190,12 +396,38 @@ std::string get_fig_0_13_userapp(int user_app_type)
 #define no_argument 0
 #define required_argument 1
 #define optional_argument 2
+
+#define OPT_BUILD_INDEX 256
+#define OPT_INDEX       257
+#define OPT_START       258
+#define OPT_END         259
+#define OPT_DECODE_ALL  260
+#define OPT_OUTPUTS     261
+#define OPT_STATS       262
+#define OPT_VALIDATE    263
+#define OPT_ENSEMBLE    264
+#define OPT_CAROUSEL    265
+
 const struct option longopts[] = {
     {"help",               no_argument,        0, 'h'},
     {"verbose",            no_argument,        0, 'v'},
     {"ignore-error",       no_argument,        0, 'e'},
     {"decode-stream",      required_argument,  0, 'd'},
-    {"input",              required_argument,  0, 'i'}
+    {"decode-service",     required_argument,  0, 's'},
+    {"decode-all",         no_argument,        0, OPT_DECODE_ALL},
+    {"outputs",            required_argument,  0, OPT_OUTPUTS},
+    {"output-to",          required_argument,  0, 'o'},
+    {"stats",              required_argument,  0, OPT_STATS},
+    {"validate",           no_argument,        0, OPT_VALIDATE},
+    {"ensemble",           no_argument,        0, OPT_ENSEMBLE},
+    {"carousel",           required_argument,  0, OPT_CAROUSEL},
+    {"input",              required_argument,  0, 'i'},
+    {"build-index",        required_argument,  0, OPT_BUILD_INDEX},
+    {"index",              required_argument,  0, OPT_INDEX},
+    {"start",              required_argument,  0, OPT_START},
+    {"end",                required_argument,  0, OPT_END},
+    {"jobs",               required_argument,  0, 'j'},
+    {0, 0, 0, 0}
 };
 
 void usage(void)
@@ -204,11 +436,178 @@ void usage(void)
             "ETISnoop analyser\n\n"
             "The ETSnoop analyser decodes and prints out a RAW ETI file in a\n"
             "form that makes analysis easier.\n"
-            "Usage: etisnoop [-v] [-f] [-i filename] [-d stream_index]\n"
+            "Usage: etisnoop [-v] [-f] [-i filename] [-d stream_index] [-s SId]\n"
+            "                [--decode-all] [--outputs list] [-o output=target]\n"
+            "                [--stats seconds] [--validate] [--ensemble]\n"
+            "                [--carousel seconds]\n"
+            "                [--index file] [--start pos] [--end pos] [-j N]\n"
+            "       etisnoop -i filename --build-index file\n"
             "\n"
             "   -v      increase verbosity (can be given more than once)\n"
             "   -d N    decode subchannel N into .dabp, .aac and .wav files\n"
-            "   -f      analyse FIC carousel\n");
+            "   -s SId  decode the audio of service SId (e.g. 0x4001)\n"
+            "   --decode-all     decode all DAB+ subchannels, each in its own\n"
+            "                    thread, into stream-SUBCHID files. Cannot\n"
+            "                    be combined with -d or -s\n"
+            "   --outputs L      files to write when decoding, a comma separated\n"
+            "                    list of dabp, aac, wav and pcm (default: dabp,\n"
+            "                    aac and wav), or none. Without wav or pcm, the\n"
+            "                    audio is not decoded\n"
+            "   -o O=T  write output O (dabp, aac, wav or pcm) of the only\n"
+            "           decoded subchannel to T instead of a file: - for\n"
+            "           stdout, fd:N for file descriptor N, or a file name\n"
+            "           or FIFO. Without --outputs, only the outputs given\n"
+            "           with -o are written. When an output goes to stdout,\n"
+            "           the analysis is printed on stderr\n"
+            "   --stats S        print the reception statistics of the decoded\n"
+            "                    subchannels every S seconds of audio, and not\n"
+            "                    only at the end\n"
+            "   --validate       check the AAC syntax of the AUs of the decoded\n"
+            "                    subchannels, without decoding them\n"
+            "   --ensemble       print the changes of the ensemble configuration\n"
+            "                    (services, subchannels, labels) as they are\n"
+            "                    signalled, and the configuration at the end\n"
+            "   --carousel S     print the repetition rates of the FIGs over 1, 10\n"
+            "                    and 60 seconds, the longest gap between two\n"
+            "                    repetitions and the use of the FIBs every S\n"
+            "                    seconds, and at the end\n"
+            "   -f      analyse FIC carousel\n"
+            "   -j N    analyse the frames with N threads, at most 64 (seekable\n"
+            "           files only)\n"
+            "   --build-index F  write the frame index of the input to F and exit\n"
+            "   --index F        use index F to seek to the --start position\n"
+            "   --start P        start analysis at position P\n"
+            "   --end P          stop analysis before position P\n"
+            "\n"
+            "Positions are frame numbers, seconds from the beginning\n"
+            "of the file when followed by 's' (e.g. 3600s), or cif:N for\n"
+            "the first frame with CIF count N in the --index, counting\n"
+            "from the start for --end.\n");
+}
+
+/* A --start or --end position, either a frame number, or a CIF count
+ * that is looked up in the index */
+struct frame_position_t {
+    long frame;
+    long cif_count;  // -1 unless given as cif:N
+};
+
+/* Parse a --start or --end position. Returns false if it is invalid */
+bool parse_frame_position(const char* position, frame_position_t& pos)
+{
+    char* end;
+
+    pos.frame = -1;
+    pos.cif_count = -1;
+
+    if (strncmp(position, "cif:", 4) == 0) {
+        long cif_count = strtol(position + 4, &end, 10);
+        if (end == position + 4 || *end != '\0' ||
+                cif_count < 0 || cif_count >= 5000) {
+            return false;
+        }
+        pos.cif_count = cif_count;
+        return true;
+    }
+
+    double value = strtod(position, &end);
+    if (end == position || value < 0) {
+        return false;
+    }
+
+    if (strcmp(end, "s") == 0) {
+        // One ETI frame every 24ms
+        pos.frame = value * 1000 / 24;
+    }
+    else if (*end == '\0') {
+        pos.frame = value;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+/* Find the frame of the position, searching the index from frame first
+ * for a CIF count. Returns -1 if it is not in the index */
+long resolve_frame_position(const frame_position_t& pos,
+        const vector<eti_index_entry_t>& index, long first)
+{
+    if (pos.cif_count == -1) {
+        return pos.frame;
+    }
+
+    for (size_t i = first; i < index.size(); i++) {
+        if ((index[i].flags & ETI_INDEX_HAS_CIF_COUNT) &&
+                index[i].cif_count == pos.cif_count) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Parse the --outputs list into DPS_OUTPUT_* flags, -1 if invalid */
+int parse_outputs(const char* list)
+{
+    int outputs = 0;
+    string s(list);
+    size_t start = 0;
+
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == string::npos) {
+            end = s.size();
+        }
+
+        const string name = s.substr(start, end - start);
+        if (name == "dabp") {
+            outputs |= DPS_OUTPUT_DABP;
+        }
+        else if (name == "aac") {
+            outputs |= DPS_OUTPUT_AAC;
+        }
+        else if (name == "wav") {
+            outputs |= DPS_OUTPUT_WAV;
+        }
+        else if (name == "pcm") {
+            outputs |= DPS_OUTPUT_PCM;
+        }
+        else if (name == "none") {
+        }
+        else {
+            return -1;
+        }
+
+        start = end + 1;
+    }
+
+    return outputs;
+}
+
+/* An -o option */
+struct output_target_t {
+    int output;
+    string target;
+};
+
+/* Parse -o output=target, returns false if invalid */
+bool parse_output_target(const char* arg, output_target_t& target)
+{
+    const char* eq = strchr(arg, '=');
+    if (eq == NULL || eq[1] == '\0') {
+        return false;
+    }
+
+    target.output = parse_outputs(string(arg, eq - arg).c_str());
+    target.target = eq + 1;
+
+    if (target.target.compare(0, 3, "fd:") == 0 &&
+            fcntl(atoi(target.target.c_str() + 3), F_GETFD) == -1) {
+        return false;
+    }
+
+    // Exactly one output
+    return target.output > 0 && (target.output & (target.output - 1)) == 0;
 }
 
 int main(int argc, char *argv[])
@@ -216,20 +615,39 @@ int main(int argc, char *argv[])
     int index;
     int ch = 0;
     string file_name("-");
-    map<int, DabPlusSnoop> streams_to_decode;
+    vector<decode_selection_t> selections;
 
     verbosity = 0;
+    analysis_out = stdout;
     bool ignore_error = false;
     bool analyse_fic_carousel = false;
+    string build_index_file;
+    string index_file;
+    frame_position_t start_pos = {0, -1};
+    frame_position_t end_pos = {-1, -1};
+    int num_threads = 1;
+    bool decode_all = false;
+    int outputs = -1;
+    vector<output_target_t> targets;
+    int stats_interval = 0;
+    bool validate = false;
+    bool ensemble = false;
+    long carousel_interval = -1;
 
     while(ch != -1) {
-        ch = getopt_long(argc, argv, "d:efhvi:", longopts, &index);
+        ch = getopt_long(argc, argv, "d:efhvi:j:o:s:", longopts, &index);
         switch (ch) {
             case 'd':
+            case 's':
                 {
-                    int subchix = atoi(optarg);
-                DabPlusSnoop dps;
-                streams_to_decode[subchix] = dps;
+                    decode_selection_t sel;
+                    sel.stream_index = (ch == 'd') ? atoi(optarg) : -1;
+                    sel.sid = (ch == 's') ? strtoul(optarg, NULL, 0) : 0;
+                    sel.subchid = -1;
+                    sel.dps = new DabPlusSnoop();
+                    sel.dps->set_index(
+                            (ch == 'd') ? sel.stream_index : (int)sel.sid);
+                    selections.push_back(sel);
                 }
                 break;
             case 'e':
@@ -238,6 +656,19 @@ int main(int argc, char *argv[])
             case 'i':
                 file_name = optarg;
                 break;
+            case 'j':
+                {
+                    char* end;
+                    long threads = strtol(optarg, &end, 10);
+                    if (end == optarg || *end != '\0' || threads < 1 ||
+                            threads > MAX_ANALYSIS_THREADS) {
+                        fprintf(stderr, "Invalid -j %s, must be between "
+                                "1 and %d\n", optarg, MAX_ANALYSIS_THREADS);
+                        return 1;
+                    }
+                    num_threads = threads;
+                }
+                break;
             case 'f':
                 analyse_fic_carousel = true;
                 break;
@@ -248,7 +679,119 @@ int main(int argc, char *argv[])
                 usage();
                 return 1;
                 break;
+            case OPT_BUILD_INDEX:
+                build_index_file = optarg;
+                break;
+            case OPT_INDEX:
+                index_file = optarg;
+                break;
+            case OPT_START:
+                if (!parse_frame_position(optarg, start_pos)) {
+                    fprintf(stderr, "Invalid --start %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_END:
+                if (!parse_frame_position(optarg, end_pos)) {
+                    fprintf(stderr, "Invalid --end %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_DECODE_ALL:
+                decode_all = true;
+                break;
+            case OPT_OUTPUTS:
+                outputs = parse_outputs(optarg);
+                if (outputs == -1) {
+                    fprintf(stderr, "Invalid --outputs %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_VALIDATE:
+                validate = true;
+                break;
+            case OPT_ENSEMBLE:
+                ensemble = true;
+                break;
+            case OPT_CAROUSEL:
+                carousel_interval = atof(optarg) * 1000 / CAROUSEL_FRAME_MS;
+                if (carousel_interval <= 0) {
+                    fprintf(stderr, "Invalid --carousel %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_STATS:
+                // One superframe every 120ms
+                stats_interval = atof(optarg) * 1000 / 120;
+                if (stats_interval <= 0) {
+                    fprintf(stderr, "Invalid --stats %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o':
+                {
+                    output_target_t target;
+                    if (!parse_output_target(optarg, target)) {
+                        fprintf(stderr, "Invalid -o %s\n", optarg);
+                        return 1;
+                    }
+                    targets.push_back(target);
+                }
+                break;
+        }
+    }
+
+    if (decode_all && !selections.empty()) {
+        fprintf(stderr, "--decode-all cannot be combined with -d or -s\n");
+        return 1;
+    }
+
+    if (!targets.empty()) {
+        if (selections.size() != 1 || decode_all) {
+            fprintf(stderr, "-o needs exactly one -d or -s\n");
+            return 1;
+        }
+
+        int target_outputs = 0;
+        bool have_stdout = false;
+        for (size_t i = 0; i < targets.size(); i++) {
+            if (targets[i].target == "-") {
+                if (have_stdout) {
+                    fprintf(stderr, "Only one output can go to stdout\n");
+                    return 1;
+                }
+                have_stdout = true;
+
+                // Keep the real stdout for the output, everything
+                // printed goes to stderr
+                int fd = dup(STDOUT_FILENO);
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+
+                stringstream ss;
+                ss << "fd:" << fd;
+                targets[i].target = ss.str();
+            }
+
+            selections[0].dps->set_output_target(
+                    targets[i].output, targets[i].target);
+            target_outputs |= targets[i].output;
+        }
+
+        if (outputs == -1) {
+            outputs = target_outputs;
         }
+        else {
+            outputs |= target_outputs;
+        }
+    }
+    else if (outputs == -1) {
+        outputs = DPS_OUTPUT_ALL;
+    }
+
+    for (size_t i = 0; i < selections.size(); i++) {
+        selections[i].dps->set_outputs(outputs);
+        selections[i].dps->set_stats_interval(stats_interval);
+        selections[i].dps->set_validate(validate);
     }
 
     FILE* etifd;
@@ -265,869 +808,1664 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (!build_index_file.empty()) {
+        int ret = eti_index_build(etifd, build_index_file);
+        fclose(etifd);
+        return ret == 0 ? 0 : 1;
+    }
+
     eti_analyse_config_t config = {
         .etifd = etifd,
         .ignore_error = ignore_error,
-        .streams_to_decode = streams_to_decode,
-        .analyse_fic_carousel = analyse_fic_carousel
+        .selections = selections,
+        .decode_all = decode_all,
+        .outputs = outputs,
+        .stats_interval = stats_interval,
+        .validate = validate,
+        .analyse_fic_carousel = analyse_fic_carousel,
+        .ensemble = ensemble ? new EnsembleDatabase() : NULL,
+        .carousel = carousel_interval > 0 ? new FICCarouselAnalyser() : NULL,
+        .index = vector<eti_index_entry_t>(),
+        .start_frame = 0,
+        .end_frame = -1,
+        .num_threads = num_threads
     };
-    eti_analyse(config);
-    fclose(etifd);
-}
-
-int eti_analyse(eti_analyse_config_t& config)
-{
-    unsigned char p[ETINIPACKETSIZE];
-    string desc;
-    char prevsync[3]={0x00,0x00,0x00};
-    unsigned char ficf,nst,fp,mid,ficl;
-    unsigned short int fl,crch;
-    unsigned short int crc;
-    unsigned char scid,tpl,l1;
-    unsigned short int sad[64],stl[64];
-    char sdesc[256];
 
-    bool running = true;
-
-    int stream_type = ETI_STREAM_TYPE_NONE;
-    if (identify_eti_format(config.etifd, &stream_type) == -1) {
-        printf("Could not identify stream type\n");
+    if (config.carousel) {
+        config.carousel->set_interval(carousel_interval);
+    }
 
-        running = false;
+    if (!index_file.empty()) {
+        if (eti_index_load(etifd, index_file, config.index) == -1) {
+            fclose(etifd);
+            return 1;
+        }
     }
-    else {
-        printf("Identified ETI type ");
-        if (stream_type == ETI_STREAM_TYPE_RAW)
-            printf("RAW\n");
-        else if (stream_type == ETI_STREAM_TYPE_STREAMED)
-            printf("STREAMED\n");
-        else if (stream_type == ETI_STREAM_TYPE_FRAMED)
-            printf("FRAMED\n");
-        else
-            printf("?\n");
+
+    if ((start_pos.cif_count != -1 || end_pos.cif_count != -1) &&
+            config.index.empty()) {
+        fprintf(stderr, "cif: positions need --index\n");
+        fclose(etifd);
+        return 1;
     }
 
-    while (running) {
+    config.start_frame = resolve_frame_position(start_pos, config.index, 0);
+    if (config.start_frame == -1) {
+        fprintf(stderr, "No frame with CIF count %ld in the index\n",
+                start_pos.cif_count);
+        fclose(etifd);
+        return 1;
+    }
 
-        int ret = get_eti_frame(config.etifd, stream_type, p);
-        if (ret == -1) {
-            fprintf(stderr, "ETI file read error\n");
-            break;
+    // The end is the first frame with the CIF count after the start
+    if (end_pos.frame != -1 || end_pos.cif_count != -1) {
+        config.end_frame = resolve_frame_position(end_pos, config.index,
+                config.start_frame);
+        if (config.end_frame == -1) {
+            fprintf(stderr, "No frame with CIF count %ld after --start "
+                    "in the index\n", end_pos.cif_count);
+            fclose(etifd);
+            return 1;
         }
-        else if (ret == 0) {
-            fprintf(stderr, "End of ETI\n");
-            break;
+
+        if (config.end_frame < config.start_frame) {
+            fprintf(stderr, "--end must not be before --start\n");
+            fclose(etifd);
+            return 1;
         }
+    }
+
+    eti_analyse(config);
+    fclose(etifd);
 
-        // SYNC
-        printbuf("SYNC", 0, p, 4);
+    delete config.ensemble;
+    delete config.carousel;
+}
+
+/* Update prevsync with the FSYNC of the frame, and return the
+ * description of the FSYNC check */
+const char* check_fsync(char prevsync[3], const unsigned char* p)
+{
+    const char* desc = "OK";
 
-        // SYNC - ERR
-        if (p[0] == 0xFF) {
-            desc = "No error";
-            printbuf("ERR", 1, p, 1, desc);
+    if (memcmp(prevsync, "\x00\x00\x00", 3) == 0) {
+        if ( (memcmp(p + 1, "\x07\x3a\xb6", 3) == 0) ||
+             (memcmp(p + 1, "\xf8\xc5\x49", 3) == 0) ) {
+            desc = "OK";
+            memcpy(prevsync, p+1, 3);
         }
         else {
-            desc = "Error";
-            printbuf("ERR", 1, p, 1, desc);
-            if (!config.ignore_error) {
-                printf("Aborting because of SYNC error\n");
-                break;
-            }
+            desc ="Wrong FSYNC";
+            memcpy(prevsync, "\x00\x00\x00", 3);
+        }
+    } else if (memcmp(prevsync, "\x07\x3a\xb6", 3) == 0) {
+        if (memcmp(p + 1, "\xf8\xc5\x49", 3) != 0) {
+            desc = "Wrong FSYNC";
+            memcpy(prevsync, "\x00\x00\x00", 3);
+        } else {
+            desc = "OK";
+            memcpy(prevsync, p + 1, 3);
         }
+    } else if (memcmp(prevsync, "\xf8\xc5\x49", 3) == 0) {
+        if (memcmp(p + 1, "\x07\x3a\xb6", 3) != 0) {
+            desc = "Wrong FSYNC";
+            memcpy(prevsync, "\x00\x00\x00", 3);
+        } else {
+            desc = "OK";
+            memcpy(prevsync, p + 1, 3);
+        }
+    }
 
-        // SYNC - FSYNC
+    return desc;
+}
 
-        if (memcmp(prevsync, "\x00\x00\x00", 3) == 0) {
-            if ( (memcmp(p + 1, "\x07\x3a\xb6", 3) == 0) ||
-                 (memcmp(p + 1, "\xf8\xc5\x49", 3) == 0) ) {
-                desc = "OK";
-                memcpy(prevsync, p+1, 3);
-            }
-            else {
-                desc ="Wrong FSYNC";
-                memcpy(prevsync, "\x00\x00\x00", 3);
+/* Print the FC, STC and EOH of the frame */
+void print_eti_header(const EtiFrame& eti)
+{
+    const unsigned char* p = eti.raw;
+    char sdesc[256];
+
+    // LIDATA
+    printbuf("LDATA", 0, NULL, 0);
+    // LIDATA - FC
+    printbuf("FC - Frame Characterization field", 1, p+4, 4);
+    // LIDATA - FC - FCT
+    sprintf(sdesc, "%d", eti.fct);
+    printbuf("FCT  - Frame Count", 2, p+4, 1, sdesc);
+    // LIDATA - FC - FICF
+    sprintf(sdesc, "%d%s", eti.ficf, eti.ficf == 1 ?
+            "- FIC Information are present" :
+            "- FIC Information are not present");
+    printbuf("FICF - Fast Information Channel Flag", 2, NULL, 0, sdesc);
+
+    // LIDATA - FC - NST
+    sprintf(sdesc, "%d", eti.nst);
+    printbuf("NST  - Number of streams", 2, NULL, 0, sdesc);
+
+    // LIDATA - FC - FP
+    sprintf(sdesc, "%d", eti.fp);
+    printbuf("FP   - Frame Phase", 2, &eti.fp, 1, sdesc);
+
+    // LIDATA - FC - MID
+    sprintf(sdesc, "Mode %d", eti.mid != 0 ? eti.mid : 4);
+    printbuf("MID  - Mode Identity", 2, &eti.mid, 1, sdesc);
+
+    // LIDATA - FC - FL
+    sprintf(sdesc, "%d words", eti.fl);
+    printbuf("FL   - Frame Length", 2, NULL, 0, sdesc);
+
+    // STC
+    printbuf("STC - Stream Characterisation", 1, NULL, 0);
+
+    for (int i=0; i < eti.nst; i++) {
+        const EtiStream& stream = eti.streams[i];
+        const unsigned char tpl = stream.tpl;
+
+        sprintf(sdesc, "Stream number %d", i);
+        printbuf("STC  - Stream Characterisation", 2, p + 8 + 4*i, 4, sdesc);
+        sprintf(sdesc, "%d", stream.scid);
+        printbuf("SCID - Sub-channel Identifier", 3, NULL, 0, sdesc);
+        sprintf(sdesc, "%d", stream.sad);
+        printbuf("SAD  - Sub-channel Start Address", 3, NULL, 0, sdesc);
+
+        if ((tpl & 0x20) >> 5 == 1) {
+            unsigned char opt, plevel;
+            const char* plevelstr = "";
+            char unknown_opt[32];
+            opt = (tpl & 0x1c) >> 2;
+            plevel = (tpl & 0x03);
+            if (opt == 0x00) {
+                if (plevel == 0)
+                    plevelstr = "1-A, 1/4, 16 CUs";
+                else if (plevel == 1)
+                    plevelstr = "2-A, 3/8, 8 CUs";
+                else if (plevel == 2)
+                    plevelstr = "3-A, 1/2, 6 CUs";
+                else if (plevel == 3)
+                    plevelstr = "4-A, 3/4, 4 CUs";
             }
-        } else if (memcmp(prevsync, "\x07\x3a\xb6", 3) == 0) {
-            if (memcmp(p + 1, "\xf8\xc5\x49", 3) != 0) {
-                desc = "Wrong FSYNC";
-                memcpy(prevsync, "\x00\x00\x00", 3);
-            } else {
-                desc = "OK";
-                memcpy(prevsync, p + 1, 3);
+            else if (opt == 0x01) {
+                if (plevel == 0)
+                    plevelstr = "1-B, 4/9, 27 CUs";
+                else if (plevel == 1)
+                    plevelstr = "2-B, 4/7, 21 CUs";
+                else if (plevel == 2)
+                    plevelstr = "3-B, 4/6, 18 CUs";
+                else if (plevel == 3)
+                    plevelstr = "4-B, 4/5, 15 CUs";
             }
-        } else if (memcmp(prevsync, "\xf8\xc5\x49", 3) == 0) {
-            if (memcmp(p + 1, "\x07\x3a\xb6", 3) != 0) {
-                desc = "Wrong FSYNC";
-                memcpy(prevsync, "\x00\x00\x00", 3);
-            } else {
-                desc = "OK";
-                memcpy(prevsync, p + 1, 3);
+            else {
+                sprintf(unknown_opt, "Unknown option %d", opt);
+                plevelstr = unknown_opt;
             }
+            sprintf(sdesc, "0x%02x - Equal Error Protection. %s", tpl, plevelstr);
+        }
+        else {
+            unsigned char tsw, uepidx;
+            tsw = (tpl & 0x08);
+            uepidx = tpl & 0x07;
+            sprintf(sdesc, "0x%02x - Unequal Error Protection. Table switch %d,  UEP index %d", tpl, tsw, uepidx);
         }
-        printbuf("Sync FSYNC", 1, p + 1, 3, desc);
+        printbuf("TPL  - Sub-channel Type and Protection Level", 3, NULL, 0, sdesc);
+        sprintf(sdesc, "%d => %d kbit/s", stream.stl, stream.stl*8/3);
+        printbuf("STL  - Sub-channel Stream Length", 3, NULL, 0, sdesc);
+    }
 
-        // LIDATA
-        printbuf("LDATA", 0, NULL, 0);
-        // LIDATA - FC
-        printbuf("FC - Frame Characterization field", 1, p+4, 4);
-        // LIDATA - FC - FCT
-        char fct[25];
-        sprintf(fct, "%d", p[4]);
-        printbuf("FCT  - Frame Count", 2, p+4, 1, fct);
-        // LIDATA - FC - FICF
-        ficf = (p[5] & 0x80) >> 7;
+    // EOH
+    const unsigned char* eoh = p + 8 + 4*eti.nst;
+    printbuf("EOH - End Of Header", 1, eoh, 4);
+    sprintf(sdesc, "%d", eti.mnsc);
+    printbuf("MNSC - Multiplex Network Signalling Channel", 2, eoh, 2, sdesc);
 
-        {
-            stringstream ss;
-            ss << (int)ficf;
-            if (ficf == 1) {
-                ss << "- FIC Information are present";
-            }
-            else {
-                ss << "- FIC Information are not present";
-            }
+    const unsigned short int crc = eti_frame_header_crc(eti);
+    if (crc == eti.header_crc) {
+        sprintf(sdesc,"CRC OK");
+    }
+    else {
+        sprintf(sdesc,"CRC Mismatch: %02x",crc);
+    }
 
-            printbuf("FICF - Fast Information Channel Flag", 2, NULL, 0, ss.str());
-        }
+    printbuf("Header CRC", 2, eoh + 2, 2, sdesc);
+}
 
-        // LIDATA - FC - NST
-        nst = p[5] & 0x7F;
-        {
-            stringstream ss;
-            ss << (int)nst;
-            printbuf("NST  - Number of streams", 2, NULL, 0, ss.str());
-        }
+/* Print the EOF and TIST of the frame */
+void print_eti_eof(const EtiFrame& eti)
+{
+    const unsigned char* eof = eti.mst + eti.mst_length;
+    char sdesc[256];
 
-        // LIDATA - FC - FP
-        fp = (p[6] & 0xE0) >> 5;
-        {
-            stringstream ss;
-            ss << (int)fp;
-            printbuf("FP   - Frame Phase", 2, &fp, 1, ss.str());
-        }
+    const unsigned short int crc = eti_frame_eof_crc(eti);
+    if (crc == eti.eof_crc)
+        sprintf(sdesc, "CRC OK");
+    else
+        sprintf(sdesc, "CRC Mismatch: %02x", crc);
 
-        // LIDATA - FC - MID
-        mid = (p[6] & 0x18) >> 3;
-        {
-            stringstream ss;
-            ss << "Mode ";
-            if (mid != 0) {
-                ss << (int)mid;
-            }
-            else {
-                ss << "4";
-            }
-            printbuf("MID  - Mode Identity", 2, &mid, 1, ss.str());
-        }
+    printbuf("EOF", 1, eof, 4);
+    printbuf("CRC", 2, eof, 2, sdesc);
 
-        // LIDATA - FC - FL
-        fl = (p[6] & 0x07) * 256 + p[7];
-        {
-            stringstream ss;
-            ss << fl << " words";
-            printbuf("FL   - Frame Length", 2, NULL, 0, ss.str());
-        }
+    //RFU
+    printbuf("RFU", 2, eof + 2, 2);
 
-        if (ficf == 0) {
-            ficl = 0;
-        }
-        else if (mid == 3) {
-            ficl = 32;
-        }
-        else {
-            ficl = 24;
-        }
-
-        // STC
-        printbuf("STC - Stream Characterisation", 1, NULL, 0);
-
-        for (int i=0; i < nst; i++) {
-            sprintf(sdesc, "Stream number %d", i);
-            printbuf("STC  - Stream Characterisation", 2, p + 8 + 4*i, 4, sdesc);
-            scid = (p[8 + 4*i] & 0xFC) >> 2;
-            sprintf(sdesc, "%d", scid);
-            printbuf("SCID - Sub-channel Identifier", 3, NULL, 0, sdesc);
-            sad[i] = (p[8+4*i] & 0x03) * 256 + p[9+4*i];
-            sprintf(sdesc, "%d", sad[i]);
-            printbuf("SAD  - Sub-channel Start Address", 3, NULL, 0, sdesc);
-            tpl = (p[10+4*i] & 0xFC) >> 2;
-
-            if ((tpl & 0x20) >> 5 == 1) {
-                unsigned char opt, plevel;
-                string plevelstr;
-                opt = (tpl & 0x1c) >> 2;
-                plevel = (tpl & 0x03);
-                if (opt == 0x00) {
-                    if (plevel == 0)
-                        plevelstr = "1-A, 1/4, 16 CUs";
-                    else if (plevel == 1)
-                        plevelstr = "2-A, 3/8, 8 CUs";
-                    else if (plevel == 2)
-                        plevelstr = "3-A, 1/2, 6 CUs";
-                    else if (plevel == 3)
-                        plevelstr = "4-A, 3/4, 4 CUs";
-                }
-                else if (opt == 0x01) {
-                    if (plevel == 0)
-                        plevelstr = "1-B, 4/9, 27 CUs";
-                    else if (plevel == 1)
-                        plevelstr = "2-B, 4/7, 21 CUs";
-                    else if (plevel == 2)
-                        plevelstr = "3-B, 4/6, 18 CUs";
-                    else if (plevel == 3)
-                        plevelstr = "4-B, 4/5, 15 CUs";
-                }
-                else {
-                    stringstream ss;
-                    ss << "Unknown option " << opt;
-                    plevelstr = ss.str();
-                }
-                sprintf(sdesc, "0x%02x - Equal Error Protection. %s", tpl, plevelstr.c_str());
-            }
-            else {
-                unsigned char tsw, uepidx;
-                tsw = (tpl & 0x08);
-                uepidx = tpl & 0x07;
-                sprintf(sdesc, "0x%02x - Unequal Error Protection. Table switch %d,  UEP index %d", tpl, tsw, uepidx);
-            }
-            printbuf("TPL  - Sub-channel Type and Protection Level", 3, NULL, 0, sdesc);
-            stl[i] = (p[10+4*i] & 0x03) * 256 + \
-                      p[11+4*i];
-            sprintf(sdesc, "%d => %d kbit/s", stl[i], stl[i]*8/3);
-            printbuf("STL  - Sub-channel Stream Length", 3, NULL, 0, sdesc);
-
-            if (config.streams_to_decode.count(i) > 0) {
-                config.streams_to_decode[i].set_subchannel_index(stl[i]/3);
-                config.streams_to_decode[i].set_index(i);
-            }
-        }
+    //TIST
+    const unsigned char l1 = (eti.tist >> 17) & 0x7f;
+    sprintf(sdesc, "%d ms", l1*8);
+    printbuf("TIST - Time Stamp", 1, eof + 4, 4, sdesc);
 
-        // EOH
-        printbuf("EOH - End Of Header", 1, p + 8 + 4*nst, 4);
-        unsigned short int mnsc = p[8 + 4*nst] * 256 + \
-                                  p[8 + 4*nst + 1];
-        {
-            stringstream ss;
-            ss << mnsc;
-            printbuf("MNSC - Multiplex Network Signalling Channel", 2, p+8+4*nst, 2, ss.str());
-        }
+    fprintf(analysis_out, "-------------------------------------------------------------------------------------------------------------\n");
+}
+
+/* Analyse one frame, writing the output to analysis_out.
+ * The streams are given to the decoders in frame.decoders if decode is
+ * true, otherwise they are recorded in the frame pushes.
+ * Return false if the analysis must be aborted after this frame. */
+bool eti_analyse_frame(const eti_analyse_config_t& config,
+        eti_frame_analysis_t& frame,
+        bool decode,
+        eti_cif_tracker_t* cif_tracker)
+{
+    EtiFrame eti;
+    unsigned char* p = frame.p;
+    unsigned short int crc;
+    char sdesc[256];
 
-        crch = p[8 + 4*nst + 2]*256 + \
-               p[8 + 4*nst + 3];
-        crc  = 0xffff;
+    // Everything that is only needed for the output is skipped when
+    // nothing gets printed
+    const bool print = (verbosity > 0);
 
-        for (int i=4; i < 8 + 4*nst + 2; i++)
-            crc = update_crc_ccitt(crc, p[i]);
-        crc =~ crc;
+    frame.num_pushes = 0;
 
-        if (crc == crch) {
-            sprintf(sdesc,"CRC OK");
-        }
-        else {
-            sprintf(sdesc,"CRC Mismatch: %02x",crc);
+    const bool valid = eti_parse_frame(p, eti);
+
+    // The DAB+ decoders need the CIF count to find the superframes
+    frame.fp = valid ? eti.fp : -1;
+    frame.cif_count = -1;
+    if (valid && (!config.selections.empty() || config.decode_all)) {
+        frame.cif_count = eti_frame_cif_count(eti);
+    }
+
+    int cif_count = -1;
+    if (cif_tracker) {
+        cif_count = eti_cif_tracker_update(cif_tracker,
+                frame.cif_count, frame.fp);
+    }
+
+    // SYNC
+    printbuf("SYNC", 0, p, 4);
+
+    // SYNC - ERR
+    if (eti.err == 0xFF) {
+        printbuf("ERR", 1, p, 1, "No error");
+    }
+    else {
+        printbuf("ERR", 1, p, 1, "Error");
+        if (!config.ignore_error) {
+            fprintf(analysis_out, "Aborting because of SYNC error\n");
+            return false;
         }
+    }
 
-        printbuf("Header CRC", 2, p + 8 + 4*nst + 2, 2, sdesc);
+    // SYNC - FSYNC
+    printbuf("Sync FSYNC", 1, p + 1, 3, frame.fsync_desc);
 
-        // MST - FIC
-        if (ficf == 1) {
-            int endmarker = 0;
-            int figcount = 0;
-            unsigned char *fib, *fig;
-            unsigned short int figcrc;
+    if (!valid) {
+        fprintf(analysis_out, "Invalid ETI frame structure, %d streams\n",
+                eti.nst);
+        return true;
+    }
 
-            FIGalyser figs;
+    if (print) {
+        print_eti_header(eti);
+    }
 
-            unsigned char ficdata[32*4];
-            memcpy(ficdata, p + 12 + 4*nst, ficl*4);
-            sprintf(sdesc, "FIC Data (%d bytes)", ficl*4);
-            //printbuf(sdesc, 1, ficdata, ficl*4);
+    // MST - FIC
+    // With --ensemble or --carousel, the FIGs are only decoded when they
+    // get printed
+    const bool decode_fic = print || config.analyse_fic_carousel ||
+        (config.ensemble == NULL && config.carousel == NULL);
+    if (eti.ficf == 1 && decode_fic) {
+        int endmarker = 0;
+        int figcount = 0;
+        const unsigned char *fib, *fig;
+        unsigned short int figcrc;
+
+        FIGalyser figs;
+
+        if (print) {
+            sprintf(sdesc, "FIC Data (%zu bytes)", eti.fic_length);
             printbuf(sdesc, 1, NULL, 0);
-            fib = p + 12 + 4*nst;
-            for(int i = 0; i < ficl*4/32; i++) {
-                fig=fib;
-                figs.set_fib(i);
-                endmarker=0;
-                figcount=0;
-                while (!endmarker) {
-                    unsigned char figtype, figlen;
-                    figtype = (fig[0] & 0xE0) >> 5;
-                    if (figtype != 7) {
-                        figlen = fig[0] & 0x1F;
+        }
+        fib = eti.fic;
+        for(size_t i = 0; i < eti.fic_length/32; i++) {
+            fig=fib;
+            figs.set_fib(i);
+            endmarker=0;
+            figcount=0;
+            while (!endmarker) {
+                unsigned char figtype, figlen;
+                figtype = (fig[0] & 0xE0) >> 5;
+                if (figtype != 7) {
+                    figlen = fig[0] & 0x1F;
+                    if (print) {
                         sprintf(sdesc, "FIG %d [%d bytes]", figtype, figlen);
                         printbuf(sdesc, 3, fig+1, figlen);
-                        decodeFIG(figs, fig+1, figlen, figtype, 4);
-                        fig += figlen + 1;
-                        figcount += figlen + 1;
-                        if (figcount >= 29)
-                            endmarker = 1;
                     }
-                    else {
-                        endmarker = 1;
+                    const int ext = fig_extension(fig+1, figtype);
+                    if (ext != -1) {
+                        figs.push_back(figtype, ext, figlen);
                     }
+                    fig_cache.decode(fig+1, figlen, figtype, 4);
+                    fig += figlen + 1;
+                    figcount += figlen + 1;
+                    if (figcount >= 29)
+                        endmarker = 1;
                 }
-                figcrc = fib[30]*256 + fib[31];
-                crc = 0xffff;
-                for (int j = 0; j < 30; j++) {
-                    crc = update_crc_ccitt(crc, fib[j]);
+                else {
+                    endmarker = 1;
                 }
-                crc =~ crc;
-                if (crc == figcrc)
-                    sprintf(sdesc,"FIB CRC OK");
+            }
+
+            if (print) {
+                figcrc = fib[30]*256 + fib[31];
+                crc = ~crc16_ccitt(0xffff, fib, 30);
+                if (crc == figcrc)
+                    sprintf(sdesc,"FIB CRC OK");
                 else
                     sprintf(sdesc,"FIB CRC Mismatch: %02x",crc);
 
                 printbuf("FIB CRC",3,fib+30,2,sdesc);
-                fib += 32;
             }
+            fib += 32;
+        }
 
-            if (config.analyse_fic_carousel) {
-                figs.analyse();
-            }
+        if (config.analyse_fic_carousel) {
+            figs.analyse();
         }
+    }
+
+    for (int i=0; i < eti.nst; i++) {
+        const EtiStream& stream = eti.streams[i];
 
-        int offset = 0;
-        for (int i=0; i < nst; i++) {
-            unsigned char streamdata[684*8];
-            memcpy(streamdata, p + 12 + 4*nst + ficf*ficl*4 + offset, stl[i]*8);
-            offset += stl[i] * 8;
-            if (config.streams_to_decode.count(i) > 0) {
-                sprintf(sdesc, "id %d, len %d, selected for decoding", i, stl[i]*8);
+        DabPlusSnoop* dps = frame.decoders[i];
+        const bool selected = (dps != NULL);
+
+        if (print) {
+            sprintf(sdesc, "id %d, len %zu, %s", i, stream.size,
+                    selected ? "selected for decoding" :
+                    "not selected for decoding");
+            if (verbosity > 1) {
+                printbuf("Stream Data", 1, stream.data, stream.size, sdesc);
             }
             else {
-                sprintf(sdesc, "id %d, len %d, not selected for decoding", i, stl[i]*8);
+                printbuf("Stream Data", 1, stream.data, 0, sdesc);
             }
-            if (verbosity > 1) {
-                printbuf("Stream Data", 1, streamdata, stl[i]*8, sdesc);
+        }
+
+        if (selected) {
+            if (decode) {
+                dps->set_subchannel_index(stream.stl/3);
+                dps->push(stream.data, stream.size, cif_count);
             }
             else {
-                printbuf("Stream Data", 1, streamdata, 0, sdesc);
+                stream_push_t& push = frame.pushes[frame.num_pushes++];
+                push.dps = dps;
+                push.data = stream.data;
+                push.size = stream.size;
+                push.subchannel_index = stream.stl/3;
+                push.text_pos = ftell(analysis_out);
             }
+        }
+    }
+
+    if (print) {
+        print_eti_eof(eti);
+    }
 
-            if (config.streams_to_decode.count(i) > 0) {
-                config.streams_to_decode[i].push(streamdata, stl[i]*8);
+    return true;
+}
+
+/* Pool of threads analysing batches of frames. The output of each
+ * frame is written to a memory buffer, and the caller writes them out
+ * in frame order. */
+class FrameAnalysisPool
+{
+    public:
+        FrameAnalysisPool(const eti_analyse_config_t& config,
+                int num_threads) :
+            m_config(config),
+            m_frames(NULL),
+            m_num_frames(0),
+            m_generation(0),
+            m_running(0),
+            m_quit(false)
+        {
+            for (int i = 0; i < num_threads; i++) {
+                m_threads.push_back(
+                        std::thread(&FrameAnalysisPool::worker, this));
             }
+        }
 
+        ~FrameAnalysisPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_quit = true;
+            }
+            m_cond.notify_all();
+
+            for (size_t i = 0; i < m_threads.size(); i++) {
+                m_threads[i].join();
+            }
         }
 
-        // EOF
-        crch = p[12 + 4*nst + ficf*ficl*4 + offset] * 256 + \
-               p[12 + 4*nst + ficf*ficl*4 + offset + 1];
+        /* Analyse the frames, and return once all are done */
+        void analyse(eti_frame_analysis_t* frames, size_t num_frames)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_frames = frames;
+            m_num_frames = num_frames;
+            m_next_frame = 0;
+            m_running = m_threads.size();
+            m_generation++;
+            m_cond.notify_all();
+
+            m_done_cond.wait(lock, [this]{ return m_running == 0; });
+        }
 
-        crc = 0xffff;
+    private:
+        void worker()
+        {
+            unsigned long generation = 0;
 
-        for (int i = 12 + 4*nst; i < 12 + 4*nst + ficf*ficl*4 + offset; i++)
-            crc = update_crc_ccitt(crc, p[i]);
-        crc =~ crc;
-        if (crc == crch)
-            sprintf(sdesc, "CRC OK");
-        else
-            sprintf(sdesc, "CRC Mismatch: %02x", crc);
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cond.wait(lock, [&]{
+                            return m_quit || m_generation != generation; });
+                    if (m_quit) {
+                        return;
+                    }
+                    generation = m_generation;
+                }
+
+                size_t i;
+                while ((i = m_next_frame++) < m_num_frames) {
+                    eti_frame_analysis_t& frame = m_frames[i];
+
+                    analysis_out = open_memstream(&frame.text, &frame.text_len);
+                    eti_analyse_frame(m_config, frame, false, NULL);
+                    fclose(analysis_out);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (--m_running == 0) {
+                        m_done_cond.notify_one();
+                    }
+                }
+            }
+        }
+
+        const eti_analyse_config_t& m_config;
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::condition_variable m_done_cond;
+
+        eti_frame_analysis_t* m_frames;
+        size_t m_num_frames;
+        std::atomic<size_t> m_next_frame;
+        unsigned long m_generation;
+        size_t m_running;
+        bool m_quit;
+};
+
+/* Resolve the -d and -s selections with the frame, and set the decoder
+ * of each of its streams in decoders. The stream indices of -d are
+ * resolved to a SubChId at the first frame. The services of -s are
+ * followed through FIG 0/2, so that their decoding continues when the
+ * multiplex is reconfigured. */
+void update_selections(eti_analyse_config_t& config, const unsigned char* p,
+        DabPlusSnoop* decoders[ETI_MAX_STREAMS])
+{
+    std::fill(decoders, decoders + ETI_MAX_STREAMS, (DabPlusSnoop*)NULL);
+
+    EtiFrame eti;
+    if (config.selections.empty() || !eti_parse_frame(p, eti)) {
+        return;
+    }
 
-        printbuf("EOF", 1, p + 12 + 4*nst + ficf*ficl*4 + offset, 4);
-        printbuf("CRC", 2, p + 12 + 4*nst + ficf*ficl*4 + offset, 2, sdesc);
+    eti_stream_component_t components[ETI_MAX_STREAMS];
+    int num_components = -1;
 
-        //RFU
-        printbuf("RFU", 2, p + 12 + 4*nst + ficf*ficl*4 + offset + 2, 2);
+    for (size_t i = 0; i < config.selections.size(); i++) {
+        decode_selection_t& sel = config.selections[i];
+        int subchid = sel.subchid;
 
-        //TIST
-        l1 = (p[12 + 4*nst + ficf*ficl*4 + offset + 5] & 0xfe) >> 1;
-        sprintf(sdesc, "%d ms", l1*8);
-        printbuf("TIST - Time Stamp", 1, p+12+4*nst+ficf*ficl*4+offset+4, 4, sdesc);
+        if (sel.stream_index >= 0) {
+            if (subchid == -1 && sel.stream_index < eti.nst) {
+                subchid = eti.streams[sel.stream_index].scid;
+            }
+        }
+        else {
+            if (num_components == -1) {
+                num_components = eti_frame_stream_components(eti,
+                        components, ETI_MAX_STREAMS);
+            }
 
+            // The primary audio component of the service, or its
+            // first audio component
+            int found = -1;
+            for (int c = 0; c < num_components; c++) {
+                const eti_stream_component_t& comp = components[c];
+                if (comp.sid == sel.sid && comp.tmid == 0) {
+                    if (found == -1 || comp.primary) {
+                        found = comp.subchid;
+                    }
+                    if (comp.primary) {
+                        break;
+                    }
+                }
+            }
 
-        if (verbosity) {
-            printf("-------------------------------------------------------------------------------------------------------------\n");
+            if (found != -1) {
+                subchid = found;
+            }
+        }
+
+        if (subchid != sel.subchid) {
+            if (sel.subchid != -1) {
+                if (config.subchannels[sel.subchid] == sel.dps) {
+                    config.subchannels[sel.subchid] = NULL;
+                }
+                sel.dps->restart();
+            }
+            config.subchannels[subchid] = sel.dps;
+            sel.subchid = subchid;
         }
     }
 
+    for (int i = 0; i < eti.nst; i++) {
+        decoders[i] = config.subchannels[eti.streams[i].scid];
+    }
+}
 
-    std::map<int, DabPlusSnoop>::iterator it;
-    for (it = config.streams_to_decode.begin();
-            it != config.streams_to_decode.end();
-            ++it) {
-        it->second.close();
+/* Update the ensemble database and the carousel analyser with the FIC
+ * of the frame, and print what changed. Both need the frames in order. */
+void update_fic_analysis(const eti_analyse_config_t& config,
+        const eti_frame_analysis_t& frame)
+{
+    EtiFrame eti;
+    if (!eti_parse_frame(frame.p, eti)) {
+        return;
     }
 
-    return 0;
+    if (config.ensemble && eti.ficf == 1) {
+        std::vector<std::string> events;
+        config.ensemble->update_frame(eti, events);
+
+        for (size_t i = 0; i < events.size(); i++) {
+            printf("Frame %ld: %s\n", frame.number, events[i].c_str());
+        }
+    }
+
+    if (config.carousel && config.carousel->update_frame(eti)) {
+        config.carousel->print(stdout);
+    }
 }
 
-void decodeFIG(FIGalyser &figs,
-               unsigned char* f,
-               unsigned char figlen,
-               unsigned short int figtype,
-               unsigned short int indent)
+/* Hand the DAB+ subchannels of the frame to their decoder threads, and
+ * start a new thread for every DAB+ subchannel FIG 0/2 announces */
+void decode_all_frame(DabPlusDecoderThread* threads[64],
+        const eti_analyse_config_t& config,
+        const unsigned char* p, int cif_count)
 {
-    char desc[256];
+    EtiFrame eti;
+    if (!eti_parse_frame(p, eti)) {
+        return;
+    }
 
-    switch (figtype) {
-        case 0:
-            {
-                unsigned short int ext,cn,oe,pd;
-
-                cn = (f[0] & 0x80) >> 7;
-                oe = (f[0] & 0x40) >> 6;
-                pd = (f[0] & 0x20) >> 5;
-                ext = f[0] & 0x1F;
-                sprintf(desc, "FIG %d/%d: C/N=%d OE=%d P/D=%d",
-                        figtype, ext, cn, oe, pd);
-                printbuf(desc, indent, f+1, figlen-1);
-
-                figs.push_back(figtype, ext, figlen);
-
-                switch (ext) {
-
-                    case 0: // FIG 0/0
-                        {
-                            unsigned char cid, al, ch, hic, lowc, occ;
-                            unsigned short int eid, eref;
-
-                            eid  =  f[1]*256+f[2];
-                            cid  = (f[1] & 0xF0) >> 4;
-                            eref = (f[1] & 0x0F)*256 + \
-                                    f[2];
-                            ch   = (f[3] & 0xC0) >> 6;
-                            al   = (f[3] & 0x20) >> 5;
-                            hic  =  f[3] & 0x1F;
-                            lowc =  f[4];
-                            if (ch != 0) {
-                                occ = f[5];
-                                sprintf(desc,
-                                        "Ensemble ID=0x%02x (Country id=%d, Ensemble reference=%d), Change flag=%d, Alarm flag=%d, CIF Count=%d/%d, Occurance change=%d",
-                                        eid, cid, eref, ch, al, hic, lowc, occ);
-                            }
-                            else {
-                                sprintf(desc,
-                                        "Ensemble ID=0x%02x (Country id=%d, Ensemble reference=%d), Change flag=%d, Alarm flag=%d, CIF Count=%d/%d",
-                                        eid, cid, eref, ch, al, hic, lowc);
-                            }
-                            printbuf(desc, indent+1, NULL, 0);
-
-                        }
-                        break;
-                    case 1: // FIG 0/1 basic subchannel organisation
-                        {
-                            int i = 1;
-
-                            while (i < figlen-3) {
-                                // iterate over subchannels
-                                int subch_id = f[i] >> 2;
-                                int start_addr = ((f[i] & 0x03) << 8) |
-                                                 (f[i+1]);
-                                int long_flag  = (f[i+2] >> 7);
-
-                                if (long_flag) {
-                                    int option = (f[i+2] >> 4) & 0x07;
-                                    int protection_level = (f[i+2] >> 2) & 0x03;
-                                    int subchannel_size  = ((f[i+2] & 0x03) << 8 ) |
-                                                           f[i+3];
-
-                                    i += 4;
-
-                                    if (option == 0x00) {
-                                        sprintf(desc,
-                                                "Subch 0x%x, start_addr %d, long, EEP %d-A, subch size %d",
-                                                subch_id, start_addr, protection_level, subchannel_size);
-                                    }
-                                    else if (option == 0x01) {
-                                        sprintf(desc,
-                                                "Subch 0x%x, start_addr %d, long, EEP %d-B, subch size %d",
-                                                subch_id, start_addr, protection_level, subchannel_size);
-                                    }
-                                    else {
-                                        sprintf(desc,
-                                                "Subch 0x%x, start_addr %d, long, invalid option %d, protection %d, subch size %d",
-                                                subch_id, start_addr, option, protection_level, subchannel_size);
-                                    }
-                                }
-                                else {
-                                    int table_switch = (f[i+2] >> 6) & 0x01;
-                                    unsigned int table_index  = (f[i+2] & 0x3F);
-
-
-                                    if (table_switch == 0) {
-                                        sprintf(desc,
-                                                "Subch 0x%x, start_addr %d, short, table index %d",
-                                                subch_id, start_addr, table_index);
-                                    }
-                                    else {
-                                        sprintf(desc,
-                                                "Subch 0x%x, start_addr %d, short, invalid table_switch(=1), table index %d",
-                                                subch_id, start_addr, table_index);
-                                    }
-
-                                    i += 3;
-                                }
-                                printbuf(desc, indent+1, NULL, 0);
-                            }
-
-                        }
-                        break;
-                    case 2: // FIG 0/2
-                        {
-                            unsigned short int sref, sid;
-                            unsigned char cid, ecc, local, caid, ncomp, timd, ps, ca, subchid, scty;
-                            int k=1;
-                            string psdesc;
-                            char sctydesc[32];
-
-                            while (k<figlen) {
-                                if (pd == 0) {
-                                    sid  =  f[k] * 256 + f[k+1];
-                                    cid  = (f[k] & 0xF0) >> 4;
-                                    sref = (f[k] & 0x0F) * 256 + f[k+1];
-                                    k += 2;
-                                }
-                                else {
-                                    sid  =  f[k] * 256 * 256 * 256 + \
-                                            f[k+1] * 256 * 256 + \
-                                            f[k+2] * 256 + \
-                                            f[k+3];
-
-                                    ecc  =  f[k];
-                                    cid  = (f[k+1] & 0xF0) >> 4;
-                                    sref = (f[k+1] & 0x0F) * 256 * 256 + \
-                                           f[k+2] * 256 + \
-                                           f[k+3];
-
-                                    k += 4;
-                                }
-
-                                local = (f[k] & 0x80) >> 7;
-                                caid  = (f[k] & 0x70) >> 4;
-                                ncomp =  f[k] & 0x0F;
-
-                                if (pd == 0)
-                                    sprintf(desc,
-                                            "Service ID=0x%02X (Country id=%d, Service reference=%d), Number of components=%d, Local flag=%d, CAID=%d",
-                                            sid, cid, sref, ncomp, local, caid);
-                                else
-                                    sprintf(desc,
-                                            "Service ID=0x%02X (ECC=%d, Country id=%d, Service reference=%d), Number of components=%d, Local flag=%d, CAID=%d",
-                                            sid, ecc, cid, sref, ncomp, local, caid);
-                                printbuf(desc, indent+1, NULL, 0);
-
-                                k++;
-                                for (int i=0; i<ncomp; i++) {
-                                    unsigned char scomp[2];
-
-                                    memcpy(scomp, f+k, 2);
-                                    sprintf(desc, "Component[%d]", i);
-                                    printbuf(desc, indent+2, scomp, 2, "");
-                                    timd    = (scomp[0] & 0xC0) >> 6;
-                                    ps      = (scomp[1] & 0x02) >> 1;
-                                    ca      =  scomp[1] & 0x01;
-                                    scty    =  scomp[0] & 0x3F;
-                                    subchid = (scomp[1] & 0xFC) >> 2;
-
-                                    /* useless, kept as reference
-                                    if (timd == 3) {
-                                        unsigned short int scid;
-                                        scid = scty*64 + subchid;
-                                    }
-                                    */
-
-                                    if (ps == 0) {
-                                        psdesc = "Secondary service";
-                                    }
-                                    else {
-                                        psdesc = "Primary service";
-                                    }
-
-
-                                    if (timd == 0) {
-                                        //MSC stream audio
-                                        if (scty == 0)
-                                            sprintf(sctydesc, "MPEG Foreground sound (%d)", scty);
-                                        else if (scty == 1)
-                                            sprintf(sctydesc, "MPEG Background sound (%d)", scty);
-                                        else if (scty == 2)
-                                            sprintf(sctydesc, "Multi Channel sound (%d)", scty);
-                                        else if (scty == 63)
-                                            sprintf(sctydesc, "AAC sound (%d)", scty);
-                                        else
-                                            sprintf(sctydesc, "Unknown ASCTy (%d)", scty);
-
-                                        sprintf(desc, "Stream audio mode, %s, %s, SubChannel ID=%02X, CA=%d", psdesc.c_str(), sctydesc, subchid, ca);
-                                        printbuf(desc, indent+3, NULL, 0);
-                                    }
-                                    else if (timd == 1) {
-                                        // MSC stream data
-                                        sprintf(sctydesc, "DSCTy=%d", scty);
-                                        sprintf(desc, "Stream data mode, %s, %s, SubChannel ID=%02X, CA=%d", psdesc.c_str(), sctydesc, subchid, ca);
-                                        printbuf(desc, indent+3, NULL, 0);
-                                    }
-                                    else if (timd == 2) {
-                                        // FIDC
-                                        sprintf(sctydesc, "DSCTy=%d", scty);
-                                        sprintf(desc, "FIDC mode, %s, %s, Fast Information Data Channel ID=%02X, CA=%d", psdesc.c_str(), sctydesc, subchid, ca);
-                                        printbuf(desc, indent+3, NULL, 0);
-                                    }
-                                    else if (timd == 3) {
-                                        // MSC Packet mode
-                                        sprintf(desc, "MSC Packet Mode, %s, Service Component ID=%02X, CA=%d", psdesc.c_str(), subchid, ca);
-                                        printbuf(desc, indent+3, NULL, 0);
-                                    }
-                                    k += 2;
-                                }
-                            }
-                        }
-                        break;
-                    case 13: // FIG 0/13
-                        {
-                            uint32_t SId;
-                            uint8_t  SCIdS;
-                            uint8_t  No;
-
-                            int k = 1;
-
-                            if (pd == 0) { // Programme services, 16 bit SId
-                                SId   = (f[k] << 8) |
-                                         f[k+1];
-                                k+=2;
-
-                                SCIdS = f[k] >> 4;
-                                No    = f[k] & 0x0F;
-                                k++;
-                            }
-                            else { // Data services, 32 bit SId
-                                SId   = (f[k]   << 24) |
-                                        (f[k+1] << 16) |
-                                        (f[k+2] << 8) |
-                                         f[k+3];
-                                k+=4;
-
-                                SCIdS = f[k] >> 4;
-                                No    = f[k] & 0x0F;
-                                k++;
-
-                            }
-
-                            sprintf(desc, "FIG %d/%d: SId=%u SCIdS=%u No=%u",
-                                    figtype, ext, SId, SCIdS, No);
-                            printbuf(desc, indent+1, NULL, 0);
-
-                            for (int numapp = 0; numapp < No; numapp++) {
-                                uint16_t user_app_type = ((f[k] << 8) |
-                                                         (f[k+1] & 0xE0)) >> 5;
-                                uint8_t  user_app_len  = f[k+1] & 0x1F;
-                                k+=2;
-
-                                sprintf(desc, "User Application %d '%s'; length %u",
-                                        user_app_type,
-                                        get_fig_0_13_userapp(user_app_type).c_str(),
-                                        user_app_len);
-                                printbuf(desc, indent+2, NULL, 0);
-                            }
-                        }
-                        break;
+    eti_stream_component_t components[ETI_MAX_STREAMS];
+    int num = eti_frame_stream_components(eti, components, ETI_MAX_STREAMS);
+
+    for (int i = 0; i < num; i++) {
+        const eti_stream_component_t& comp = components[i];
+
+        // Audio stream with ASCTy 63, DAB+
+        if (comp.tmid == 0 && comp.scty == 63 &&
+                threads[comp.subchid] == NULL) {
+            printf("Decoding DAB+ subchannel %d of service 0x%04X\n",
+                    comp.subchid, comp.sid);
+            threads[comp.subchid] = new DabPlusDecoderThread(comp.subchid,
+                    config.outputs, config.stats_interval, config.validate);
+        }
+    }
+
+    for (int i = 0; i < eti.nst; i++) {
+        const EtiStream& stream = eti.streams[i];
+
+        if (threads[stream.scid]) {
+            threads[stream.scid]->push(stream.data, stream.size,
+                    stream.stl/3, cif_count);
+        }
+    }
+}
+
+void print_resync(long skipped)
+{
+    if (skipped) {
+        printf("Lost ETI frame alignment, resynchronised after skipping %ld bytes\n",
+                skipped);
+    }
+}
+
+int eti_analyse(eti_analyse_config_t& config)
+{
+    unsigned char* p;
+    char prevsync[3]={0x00,0x00,0x00};
+
+    bool running = true;
+
+    long num_resyncs = 0;
+    long total_skipped = 0;
+
+    struct eti_reader_t reader;
+    if (eti_reader_open(&reader, config.etifd) == -1) {
+        printf("Could not identify stream type\n");
+
+        running = false;
+    }
+    else {
+        printf("Identified ETI type ");
+        if (reader.stream_type == ETI_STREAM_TYPE_RAW)
+            printf("RAW\n");
+        else if (reader.stream_type == ETI_STREAM_TYPE_STREAMED)
+            printf("STREAMED\n");
+        else if (reader.stream_type == ETI_STREAM_TYPE_FRAMED)
+            printf("FRAMED\n");
+        else
+            printf("?\n");
+    }
+
+    long frame_nr = 0;
+
+    if (running && config.start_frame > 0) {
+        if (!config.index.empty()) {
+            if ((size_t)config.start_frame >= config.index.size() ||
+                    eti_reader_seek(&reader,
+                        config.index[config.start_frame].offset) == -1) {
+                printf("Cannot seek to frame %ld\n", config.start_frame);
+                running = false;
+            }
+            frame_nr = config.start_frame;
+        }
+        else {
+            // Without index, read through the frames before the start
+            long skipped;
+            while (frame_nr < config.start_frame &&
+                    eti_reader_next(&reader, &p, &skipped) == 6144) {
+                frame_nr++;
+            }
+        }
+    }
+
+    // The frames handed out by the mmap reader stay valid, and can
+    // be analysed in parallel
+    int num_threads = config.num_threads;
+    if (num_threads > 1 && !reader.use_mmap) {
+        fprintf(stderr, "Parallel analysis needs a seekable input file\n");
+        num_threads = 1;
+    }
+
+    eti_cif_tracker_t cif_tracker;
+    eti_cif_tracker_init(&cif_tracker);
+
+    // The decoders of --decode-all, by SubChId
+    DabPlusDecoderThread* decoder_threads[64] = {NULL};
+
+    FrameAnalysisPool* pool = NULL;
+    std::vector<eti_frame_analysis_t> frames;
+    if (num_threads > 1) {
+        pool = new FrameAnalysisPool(config, num_threads);
+        frames.resize(num_threads * 64);
+    }
+
+    while (running) {
+        size_t num_frames = 0;
+
+        // Read the next frame, or a batch of frames for the pool
+        while (num_frames < std::max((size_t)1, frames.size())) {
+            if (config.end_frame != -1 && frame_nr >= config.end_frame) {
+                running = false;
+                break;
+            }
+            frame_nr++;
+
+            long skipped;
+            int ret = eti_reader_next(&reader, &p, &skipped);
+            if (ret == -1) {
+                fprintf(stderr, "ETI file read error\n");
+                running = false;
+                break;
+            }
+            else if (ret == 0) {
+                fprintf(stderr, "End of ETI\n");
+                running = false;
+                break;
+            }
+
+            if (skipped) {
+                num_resyncs++;
+                total_skipped += skipped;
+            }
+
+            eti_frame_analysis_t frame;
+            frame.p = p;
+            frame.number = frame_nr - 1;
+            frame.fsync_desc = check_fsync(prevsync, p);
+            frame.skipped = skipped;
+            update_selections(config, p, frame.decoders);
+
+            if (pool == NULL) {
+                print_resync(skipped);
+
+                if (!eti_analyse_frame(config, frame, true, &cif_tracker)) {
+                    running = false;
+                    break;
+                }
+
+                if (config.ensemble || config.carousel) {
+                    update_fic_analysis(config, frame);
                 }
+
+                if (config.decode_all) {
+                    decode_all_frame(decoder_threads, config, p,
+                            cif_tracker.cif_count);
+                }
+                break;
             }
-            break;
 
-        case 1:
-            {// SHORT LABELS
-                unsigned short int ext,oe,charset;
-                unsigned short int flag;
-                char label[17];
-
-                charset = (f[0] & 0xF0) >> 4;
-                oe = (f[0] & 0x08) >> 3;
-                ext = f[0] & 0x07;
-                sprintf(desc,
-                        "FIG %d/%d: OE=%d, Charset=%d",
-                        figtype, ext, oe, charset);
-
-                printbuf(desc, indent, f+1, figlen-1);
-                memcpy(label, f+figlen-18, 16);
-                label[16] = 0x00;
-                flag = f[figlen-2] * 256 + \
-                       f[figlen-1];
-
-                figs.push_back(figtype, ext, figlen);
-
-                switch (ext) {
-                    case 0:
-                        { // ENSEMBLE LABEL
-                            unsigned short int eid;
-                            eid = f[1] * 256 + f[2];
-                            sprintf(desc, "Ensemble ID 0x%04X label: \"%s\", Short label mask: 0x%04X", eid, label, flag);
-                            printinfo(desc, indent+1);
-                        }
-                        break;
+            frames[num_frames++] = frame;
 
-                    case 1:
-                        { // Programme LABEL
-                            unsigned short int sid;
-                            sid = f[1] * 256 + f[2];
-                            sprintf(desc, "Service ID 0x%04X label: \"%s\", Short label mask: 0x%04X", sid, label, flag);
-                            printinfo(desc, indent+1);
-                        }
-                        break;
+            if (p[0] != 0xFF && !config.ignore_error) {
+                // The analysis aborts after this frame
+                running = false;
+                break;
+            }
+        }
 
-                    case 4:
-                        { // Service Component LABEL
-                            unsigned int sid;
-                            unsigned char pd, SCIdS;
-                            pd    = (f[1] & 0x80) >> 7;
-                            SCIdS =  f[1] & 0x0F;
-                            if (pd == 0) {
-                                sid = f[2] * 256 + \
-                                      f[3];
-                            }
-                            else {
-                                sid = f[2] * 256 * 256 * 256 + \
-                                      f[3] * 256 * 256 + \
-                                      f[4] * 256 + \
-                                      f[5];
-                            }
-                            sprintf(desc,
-                                    "Service ID  0x%08X , Service Component ID 0x%04X Short, label: \"%s\", label mask: 0x%04X",
-                                    sid, SCIdS, label, flag);
-                            printinfo(desc, indent+1);
-                        }
-                        break;
+        if (pool && num_frames) {
+            pool->analyse(&frames[0], num_frames);
 
-                    case 5:
-                        { // Data Service LABEL
-                            unsigned int sid;
-                            sid = f[1] * 256 * 256 * 256 + \
-                                  f[2] * 256 * 256 + \
-                                  f[3] * 256 + \
-                                  f[4];
-
-                            sprintf(desc,
-                                    "Service ID 0x%08X label: \"%s\", Short label mask: 0x%04X",
-                                    sid, label, flag);
-                            printinfo(desc, indent+1);
-                        }
-                        break;
+            // Write the output and decode DAB+ in frame order
+            for (size_t i = 0; i < num_frames; i++) {
+                eti_frame_analysis_t& frame = frames[i];
+                long text_pos = 0;
 
+                print_resync(frame.skipped);
 
-                    case 6:
-                        { // X-PAD User Application label
-                            unsigned int sid;
-                            unsigned char pd, SCIdS, xpadapp;
-                            string xpadappdesc;
-
-                            pd    = (f[1] & 0x80) >> 7;
-                            SCIdS =  f[1] & 0x0F;
-                            if (pd == 0) {
-                                sid = f[2] * 256 + \
-                                      f[3];
-                                xpadapp = f[4] & 0x1F;
-                            }
-                            else {
-                                sid = f[2] * 256 * 256 * 256 + \
-                                      f[3] * 256 * 256 + \
-                                      f[4] * 256 + \
-                                      f[5];
-                                xpadapp = f[6] & 0x1F;
-                            }
-
-                            if (xpadapp == 2) {
-                                xpadappdesc = "DLS";
-                            }
-                            else if (xpadapp == 12) {
-                                xpadappdesc = "MOT";
-                            }
-                            else {
-                                xpadappdesc = "?";
-                            }
-
-
-                            sprintf(desc,"Service ID  0x%08X , Service Component ID 0x%04X Short, X-PAD App %02X (%s), label: \"%s\", label mask: 0x%04X",
-                                    sid, SCIdS, xpadapp, xpadappdesc.c_str(), label, flag);
-                            printbuf(desc,indent+1,NULL,0,"");
-                        }
-                        break;
+                const int cif_count = eti_cif_tracker_update(&cif_tracker,
+                        frame.cif_count, frame.fp);
+
+                for (int j = 0; j < frame.num_pushes; j++) {
+                    stream_push_t& push = frame.pushes[j];
+
+                    fwrite(frame.text + text_pos, 1,
+                            push.text_pos - text_pos, stdout);
+                    text_pos = push.text_pos;
+
+                    push.dps->set_subchannel_index(push.subchannel_index);
+                    push.dps->push(push.data, push.size, cif_count);
+                }
+
+                fwrite(frame.text + text_pos, 1,
+                        frame.text_len - text_pos, stdout);
+                free(frame.text);
+
+                if (config.ensemble || config.carousel) {
+                    update_fic_analysis(config, frame);
+                }
+
+                if (config.decode_all) {
+                    decode_all_frame(decoder_threads, config,
+                            frame.p, cif_count);
                 }
             }
-            break;
-        case 2:
-            {// LONG LABELS
-                unsigned short int ext,oe;
+        }
+    }
 
-                uint8_t toggle_flag = (f[0] & 0x80) >> 7;
-                uint8_t segment_index = (f[0] & 0x70) >> 4;
-                oe = (f[0] & 0x08) >> 3;
-                ext = f[0] & 0x07;
-                sprintf(desc,
-                        "FIG %d/%d: OE=%d, Segment_index=%d",
-                        figtype, ext, oe, segment_index);
+    delete pool;
+
+    eti_reader_close(&reader);
+
+    if (config.ensemble) {
+        config.ensemble->print(stdout);
+    }
+
+    if (config.carousel) {
+        config.carousel->print(stdout);
+    }
+
+    if (num_resyncs) {
+        printf("Resynchronised %ld times, %ld bytes skipped in total\n",
+                num_resyncs, total_skipped);
+    }
+
+    for (size_t i = 0; i < config.selections.size(); i++) {
+        config.selections[i].dps->close();
+        delete config.selections[i].dps;
+    }
+
+    for (int subchid = 0; subchid < 64; subchid++) {
+        if (decoder_threads[subchid]) {
+            decoder_threads[subchid]->close();
+            delete decoder_threads[subchid];
+        }
+    }
+
+    return 0;
+}
+
+/* A bit field of a FIG, at a bit offset from the MSB of the first byte
+ * of the structure it belongs to, most significant bit first */
+struct fig_field_t {
+    uint16_t offset;
+    uint8_t bits;
+};
+
+static inline uint32_t fig_read(const unsigned char* p, const fig_field_t& field)
+{
+    const unsigned char* b = p + field.offset / 8;
+    const unsigned first = field.offset % 8;
+    const unsigned nbytes = (first + field.bits + 7) / 8;
+
+    uint64_t value = 0;
+    for (unsigned i = 0; i < nbytes; i++) {
+        value = (value << 8) | b[i];
+    }
+    return (value >> (nbytes * 8 - first - field.bits)) &
+        ((1ull << field.bits) - 1);
+}
+
+// Type specific header, in the first byte after the FIG header
+constexpr fig_field_t FIG0_CN       = {0, 1};
+constexpr fig_field_t FIG0_OE       = {1, 1};
+constexpr fig_field_t FIG0_PD       = {2, 1};
+constexpr fig_field_t FIG1_CHARSET  = {0, 4};
+constexpr fig_field_t FIG1_OE       = {4, 1};
+constexpr fig_field_t FIG2_TOGGLE   = {0, 1};
+constexpr fig_field_t FIG2_SEGMENT  = {1, 3};
+constexpr fig_field_t FIG2_OE       = {4, 1};
+constexpr fig_field_t FIG5_D1       = {0, 1};
+constexpr fig_field_t FIG5_D2       = {1, 1};
+constexpr fig_field_t FIG5_TCID     = {2, 3};
+
+// Service identifiers, for the FIGs that depend on P/D
+constexpr fig_field_t SID_16        = {0, 16};
+constexpr fig_field_t SID_16_CID    = {0, 4};
+constexpr fig_field_t SID_16_SREF   = {4, 12};
+constexpr fig_field_t SID_32        = {0, 32};
+constexpr fig_field_t SID_32_ECC    = {0, 8};
+constexpr fig_field_t SID_32_CID    = {8, 4};
+constexpr fig_field_t SID_32_SREF   = {12, 20};
+
+// FIG 0/0 Ensemble information
+constexpr fig_field_t FIG0_0_EID    = {0, 16};
+constexpr fig_field_t FIG0_0_CID    = {0, 4};
+constexpr fig_field_t FIG0_0_EREF   = {4, 12};
+constexpr fig_field_t FIG0_0_CHANGE = {16, 2};
+constexpr fig_field_t FIG0_0_AL     = {18, 1};
+constexpr fig_field_t FIG0_0_CIF_HI = {19, 5};
+constexpr fig_field_t FIG0_0_CIF_LO = {24, 8};
+constexpr fig_field_t FIG0_0_OCC    = {32, 8};
+
+// FIG 0/1 Basic sub-channel organisation, per sub-channel
+constexpr fig_field_t FIG0_1_SUBCHID    = {0, 6};
+constexpr fig_field_t FIG0_1_START      = {6, 10};
+constexpr fig_field_t FIG0_1_LONG       = {16, 1};
+constexpr fig_field_t FIG0_1_SWITCH     = {17, 1};
+constexpr fig_field_t FIG0_1_TABLE      = {18, 6};
+constexpr fig_field_t FIG0_1_OPTION     = {17, 3};
+constexpr fig_field_t FIG0_1_PLEVEL     = {20, 2};
+constexpr fig_field_t FIG0_1_SIZE       = {22, 10};
+
+// FIG 0/2 Basic service and service component definition
+constexpr fig_field_t FIG0_2_LOCAL      = {0, 1};
+constexpr fig_field_t FIG0_2_CAID       = {1, 3};
+constexpr fig_field_t FIG0_2_NCOMP      = {4, 4};
+constexpr fig_field_t FIG0_2_TMID       = {0, 2};
+constexpr fig_field_t FIG0_2_SCTY       = {2, 6};
+constexpr fig_field_t FIG0_2_SUBCHID    = {8, 6};
+constexpr fig_field_t FIG0_2_PS         = {14, 1};
+constexpr fig_field_t FIG0_2_CA         = {15, 1};
+
+// FIG 0/3 Service component in packet mode
+constexpr fig_field_t FIG0_3_SCID       = {0, 12};
+constexpr fig_field_t FIG0_3_CAORG_FLAG = {15, 1};
+constexpr fig_field_t FIG0_3_DG         = {16, 1};
+constexpr fig_field_t FIG0_3_DSCTY      = {18, 6};
+constexpr fig_field_t FIG0_3_SUBCHID    = {24, 6};
+constexpr fig_field_t FIG0_3_ADDRESS    = {30, 10};
+constexpr fig_field_t FIG0_3_CAORG      = {40, 16};
+
+// FIG 0/5 Service component language
+constexpr fig_field_t FIG0_5_LS         = {0, 1};
+constexpr fig_field_t FIG0_5_MSC_FIC    = {1, 1};
+constexpr fig_field_t FIG0_5_ID         = {2, 6};
+constexpr fig_field_t FIG0_5_LANGUAGE   = {8, 8};
+constexpr fig_field_t FIG0_5_SCID       = {4, 12};
+constexpr fig_field_t FIG0_5_LANGUAGE_L = {16, 8};
+
+// FIG 0/8 Service component global definition, after the SId
+constexpr fig_field_t FIG0_8_EXT        = {0, 1};
+constexpr fig_field_t FIG0_8_SCIDS      = {4, 4};
+constexpr fig_field_t FIG0_8_LS         = {8, 1};
+constexpr fig_field_t FIG0_8_SUBCHID    = {10, 6};
+constexpr fig_field_t FIG0_8_SCID       = {12, 12};
+
+// FIG 0/9 Country, LTO and International table
+constexpr fig_field_t FIG0_9_EXT        = {0, 1};
+constexpr fig_field_t FIG0_9_LTO_SIGN   = {2, 1};
+constexpr fig_field_t FIG0_9_LTO        = {3, 5};
+constexpr fig_field_t FIG0_9_ECC        = {8, 8};
+constexpr fig_field_t FIG0_9_INTER_TAB  = {16, 8};
+
+// FIG 0/10 Date and time
+constexpr fig_field_t FIG0_10_MJD       = {1, 17};
+constexpr fig_field_t FIG0_10_LSI       = {18, 1};
+constexpr fig_field_t FIG0_10_UTC_FLAG  = {20, 1};
+constexpr fig_field_t FIG0_10_HOURS     = {21, 5};
+constexpr fig_field_t FIG0_10_MINUTES   = {26, 6};
+constexpr fig_field_t FIG0_10_SECONDS   = {32, 6};
+constexpr fig_field_t FIG0_10_MS        = {38, 10};
+
+// FIG 0/13 User application information, after the SId
+constexpr fig_field_t FIG0_13_SCIDS     = {0, 4};
+constexpr fig_field_t FIG0_13_NUM       = {4, 4};
+constexpr fig_field_t FIG0_13_UA_TYPE   = {0, 11};
+constexpr fig_field_t FIG0_13_UA_LEN    = {11, 5};
+
+// FIG 0/14 FEC sub-channel organisation
+constexpr fig_field_t FIG0_14_SUBCHID   = {0, 6};
+constexpr fig_field_t FIG0_14_FEC       = {6, 2};
+
+// FIG 0/17 Programme Type
+constexpr fig_field_t FIG0_17_SID       = {0, 16};
+constexpr fig_field_t FIG0_17_SD        = {16, 1};
+constexpr fig_field_t FIG0_17_L         = {18, 1};
+constexpr fig_field_t FIG0_17_CC        = {19, 1};
+constexpr fig_field_t FIG0_17_CODE      = {3, 5};
+
+// FIG 0/18 Announcement support
+constexpr fig_field_t FIG0_18_SID       = {0, 16};
+constexpr fig_field_t FIG0_18_ASU       = {16, 16};
+constexpr fig_field_t FIG0_18_CLUSTERS  = {35, 5};
+
+// FIG 1 labels, from the type specific header
+constexpr fig_field_t FIG1_EID          = {8, 16};
+constexpr fig_field_t FIG1_SID_16       = {8, 16};
+constexpr fig_field_t FIG1_SID_32       = {8, 32};
+constexpr fig_field_t FIG1_4_PD         = {8, 1};
+constexpr fig_field_t FIG1_4_SCIDS      = {12, 4};
+constexpr fig_field_t FIG1_4_SID_16     = {16, 16};
+constexpr fig_field_t FIG1_4_SID_32     = {16, 32};
+constexpr fig_field_t FIG1_6_XPADAPP_16 = {35, 5};
+constexpr fig_field_t FIG1_6_XPADAPP_32 = {51, 5};
+
+/* A FIG to decode. f points after the FIG header, at the type specific
+ * header, and len is the length from the FIG header */
+struct fig_t {
+    const unsigned char* f;
+    int len;
+    int type;
+    int ext;
+    int indent;
+};
+
+typedef void (*fig_decoder_t)(const fig_t& fig);
+
+static void decode_fig0_header(const fig_t& fig)
+{
+    char desc[256];
+
+    sprintf(desc, "FIG %d/%d: C/N=%d OE=%d P/D=%d",
+            fig.type, fig.ext, fig_read(fig.f, FIG0_CN),
+            fig_read(fig.f, FIG0_OE), fig_read(fig.f, FIG0_PD));
+    printbuf(desc, fig.indent, fig.f+1, fig.len-1);
+}
+
+static void decode_fig0_0(const fig_t& fig)
+{
+    char desc[256];
+    const unsigned char* p = fig.f + 1;
+
+    const int change = fig_read(p, FIG0_0_CHANGE);
+    int n = sprintf(desc,
+            "Ensemble ID=0x%02x (Country id=%d, Ensemble reference=%d), Change flag=%d, Alarm flag=%d, CIF Count=%d/%d",
+            fig_read(p, FIG0_0_EID), fig_read(p, FIG0_0_CID),
+            fig_read(p, FIG0_0_EREF), change, fig_read(p, FIG0_0_AL),
+            fig_read(p, FIG0_0_CIF_HI), fig_read(p, FIG0_0_CIF_LO));
+    if (change != 0) {
+        sprintf(desc + n, ", Occurance change=%d", fig_read(p, FIG0_0_OCC));
+    }
+    printbuf(desc, fig.indent+1, NULL, 0);
+}
+
+static void decode_fig0_1(const fig_t& fig)
+{
+    char desc[256];
 
-                printbuf(desc, indent, f+1, figlen-1);
+    // iterate over subchannels
+    for (int i = 1; i < fig.len-3;) {
+        const unsigned char* p = fig.f + i;
+        const int subch_id   = fig_read(p, FIG0_1_SUBCHID);
+        const int start_addr = fig_read(p, FIG0_1_START);
 
-                figs.push_back(figtype, ext, figlen);
+        if (fig_read(p, FIG0_1_LONG)) {
+            const int option = fig_read(p, FIG0_1_OPTION);
+            const int protection_level = fig_read(p, FIG0_1_PLEVEL);
+            const int subchannel_size = fig_read(p, FIG0_1_SIZE);
+
+            if (option == 0x00 || option == 0x01) {
+                sprintf(desc,
+                        "Subch 0x%x, start_addr %d, long, EEP %d-%c, subch size %d",
+                        subch_id, start_addr, protection_level,
+                        option == 0x00 ? 'A' : 'B', subchannel_size);
             }
-            break;
-        case 5:
-            {// FIDC
-                unsigned short int ext;
+            else {
+                sprintf(desc,
+                        "Subch 0x%x, start_addr %d, long, invalid option %d, protection %d, subch size %d",
+                        subch_id, start_addr, option, protection_level, subchannel_size);
+            }
+            i += 4;
+        }
+        else {
+            const unsigned table_index = fig_read(p, FIG0_1_TABLE);
 
-                uint8_t d1 = (f[0] & 0x80) >> 7;
-                uint8_t d2 = (f[0] & 0x40) >> 6;
-                uint8_t tcid = (f[0] & 0x38) >> 5;
-                ext = f[0] & 0x07;
+            if (fig_read(p, FIG0_1_SWITCH) == 0) {
+                sprintf(desc,
+                        "Subch 0x%x, start_addr %d, short, table index %d",
+                        subch_id, start_addr, table_index);
+            }
+            else {
                 sprintf(desc,
-                        "FIG %d/%d: D1=%d, D2=%d, TCId=%d",
-                        figtype, ext, d1, d2, tcid);
+                        "Subch 0x%x, start_addr %d, short, invalid table_switch(=1), table index %d",
+                        subch_id, start_addr, table_index);
+            }
+            i += 3;
+        }
+        printbuf(desc, fig.indent+1, NULL, 0);
+    }
+}
+
+/* Format the SId at p, as the FIG P/D flag says. Returns its length */
+static int format_sid(char* desc, const unsigned char* p, int pd)
+{
+    if (pd == 0) {
+        sprintf(desc, "Service ID=0x%02X (Country id=%d, Service reference=%d)",
+                fig_read(p, SID_16), fig_read(p, SID_16_CID),
+                fig_read(p, SID_16_SREF));
+        return 2;
+    }
+    else {
+        sprintf(desc, "Service ID=0x%02X (ECC=%d, Country id=%d, Service reference=%d)",
+                fig_read(p, SID_32), fig_read(p, SID_32_ECC),
+                fig_read(p, SID_32_CID), fig_read(p, SID_32_SREF));
+        return 4;
+    }
+}
+
+static void decode_fig0_2(const fig_t& fig)
+{
+    char desc[256];
+    char sid[128];
+    const int pd = fig_read(fig.f, FIG0_PD);
+
+    for (int k = 1; k + (pd ? 5 : 3) <= fig.len;) {
+        k += format_sid(sid, fig.f + k, pd);
+
+        const unsigned char* p = fig.f + k;
+        const int ncomp = fig_read(p, FIG0_2_NCOMP);
+
+        sprintf(desc, "%s, Number of components=%d, Local flag=%d, CAID=%d",
+                sid, ncomp, fig_read(p, FIG0_2_LOCAL),
+                fig_read(p, FIG0_2_CAID));
+        printbuf(desc, fig.indent+1, NULL, 0);
+        k++;
+
+        for (int i = 0; i < ncomp && k + 2 <= fig.len; i++, k += 2) {
+            const unsigned char* scomp = fig.f + k;
+            const int tmid    = fig_read(scomp, FIG0_2_TMID);
+            const int scty    = fig_read(scomp, FIG0_2_SCTY);
+            const int subchid = fig_read(scomp, FIG0_2_SUBCHID);
+            const int ca      = fig_read(scomp, FIG0_2_CA);
+            const char* psdesc = fig_read(scomp, FIG0_2_PS) ?
+                "Primary service" : "Secondary service";
+
+            sprintf(desc, "Component[%d]", i);
+            printbuf(desc, fig.indent+2, scomp, 2, "");
+
+            if (tmid == 0) {
+                //MSC stream audio
+                const char* ascty;
+                switch (scty) {
+                    case 0:  ascty = "MPEG Foreground sound"; break;
+                    case 1:  ascty = "MPEG Background sound"; break;
+                    case 2:  ascty = "Multi Channel sound"; break;
+                    case 63: ascty = "AAC sound"; break;
+                    default: ascty = "Unknown ASCTy"; break;
+                }
+                sprintf(desc, "Stream audio mode, %s, %s (%d), SubChannel ID=%02X, CA=%d",
+                        psdesc, ascty, scty, subchid, ca);
+            }
+            else if (tmid == 1) {
+                // MSC stream data
+                sprintf(desc, "Stream data mode, %s, DSCTy=%d, SubChannel ID=%02X, CA=%d",
+                        psdesc, scty, subchid, ca);
+            }
+            else if (tmid == 2) {
+                // FIDC
+                sprintf(desc, "FIDC mode, %s, DSCTy=%d, Fast Information Data Channel ID=%02X, CA=%d",
+                        psdesc, scty, subchid, ca);
+            }
+            else {
+                // MSC Packet mode
+                sprintf(desc, "MSC Packet Mode, %s, Service Component ID=%02X, CA=%d",
+                        psdesc, subchid, ca);
+            }
+            printbuf(desc, fig.indent+3, NULL, 0);
+        }
+    }
+}
+
+static void decode_fig0_3(const fig_t& fig)
+{
+    char desc[256];
+
+    for (int k = 1; k + 5 <= fig.len;) {
+        const unsigned char* p = fig.f + k;
+        const int caorg_flag = fig_read(p, FIG0_3_CAORG_FLAG);
+
+        int n = sprintf(desc,
+                "SCId=%d, DG flag=%d, DSCTy=%d, SubChannel ID=%02X, Packet address=%d",
+                fig_read(p, FIG0_3_SCID), fig_read(p, FIG0_3_DG),
+                fig_read(p, FIG0_3_DSCTY), fig_read(p, FIG0_3_SUBCHID),
+                fig_read(p, FIG0_3_ADDRESS));
+        k += 5;
+
+        if (caorg_flag) {
+            if (k + 2 > fig.len) {
+                break;
+            }
+            sprintf(desc + n, ", CAOrg=0x%04X", fig_read(p, FIG0_3_CAORG));
+            k += 2;
+        }
+        printbuf(desc, fig.indent+1, NULL, 0);
+    }
+}
+
+static void decode_fig0_5(const fig_t& fig)
+{
+    char desc[256];
 
-                printbuf(desc, indent, f+1, figlen-1);
+    for (int k = 1; k + 2 <= fig.len;) {
+        const unsigned char* p = fig.f + k;
 
-                figs.push_back(figtype, ext, figlen);
+        if (fig_read(p, FIG0_5_LS) == 0) {
+            sprintf(desc, "%s=%d, Language=0x%02X",
+                    fig_read(p, FIG0_5_MSC_FIC) ? "FIDCId" : "SubChannel ID",
+                    fig_read(p, FIG0_5_ID), fig_read(p, FIG0_5_LANGUAGE));
+            k += 2;
+        }
+        else {
+            if (k + 3 > fig.len) {
+                break;
             }
-            break;
-        case 6:
-            {// Conditional access
-                fprintf(stderr, "ERROR: ETI contains unsupported FIG 6");
+            sprintf(desc, "SCId=%d, Language=0x%02X",
+                    fig_read(p, FIG0_5_SCID), fig_read(p, FIG0_5_LANGUAGE_L));
+            k += 3;
+        }
+        printbuf(desc, fig.indent+1, NULL, 0);
+    }
+}
+
+static void decode_fig0_8(const fig_t& fig)
+{
+    char desc[256];
+    char sid[128];
+    const int pd = fig_read(fig.f, FIG0_PD);
+
+    for (int k = 1; k + (pd ? 6 : 4) <= fig.len;) {
+        k += format_sid(sid, fig.f + k, pd);
+
+        const unsigned char* p = fig.f + k;
+        const int ext_flag = fig_read(p, FIG0_8_EXT);
+
+        if (fig_read(p, FIG0_8_LS) == 0) {
+            sprintf(desc, "%s, SCIdS=%d, SubChannel ID=%02X", sid,
+                    fig_read(p, FIG0_8_SCIDS), fig_read(p, FIG0_8_SUBCHID));
+            k += 2;
+        }
+        else {
+            if (k + 3 > fig.len) {
+                break;
             }
-            break;
+            sprintf(desc, "%s, SCIdS=%d, SCId=%d", sid,
+                    fig_read(p, FIG0_8_SCIDS), fig_read(p, FIG0_8_SCID));
+            k += 3;
+        }
+
+        // Rfa byte
+        if (ext_flag) {
+            k++;
+        }
+        printbuf(desc, fig.indent+1, NULL, 0);
+    }
+}
+
+static void decode_fig0_9(const fig_t& fig)
+{
+    char desc[256];
+    const unsigned char* p = fig.f + 1;
+
+    if (fig.len < 4) {
+        return;
+    }
+
+    const int lto = fig_read(p, FIG0_9_LTO);
+    sprintf(desc, "Ensemble LTO=%c%d:%02d, ECC=0x%02X, International table=%d%s",
+            fig_read(p, FIG0_9_LTO_SIGN) ? '-' : '+', lto / 2,
+            (lto % 2) * 30, fig_read(p, FIG0_9_ECC),
+            fig_read(p, FIG0_9_INTER_TAB),
+            fig_read(p, FIG0_9_EXT) ? ", with extended field" : "");
+    printbuf(desc, fig.indent+1, NULL, 0);
+}
+
+static void decode_fig0_10(const fig_t& fig)
+{
+    char desc[256];
+    const unsigned char* p = fig.f + 1;
+
+    if (fig.len < 5) {
+        return;
+    }
+
+    // Modified Julian Date to calendar date
+    const long mjd = fig_read(p, FIG0_10_MJD);
+    const long y0 = (long)((mjd - 15078.2) / 365.25);
+    const long m0 = (long)((mjd - 14956.1 - (long)(y0 * 365.25)) / 30.6001);
+    const int day = mjd - 14956 - (long)(y0 * 365.25) - (long)(m0 * 30.6001);
+    const int k = (m0 == 14 || m0 == 15) ? 1 : 0;
+    const int year = y0 + k + 1900;
+    const int month = m0 - 1 - k * 12;
+
+    int n = sprintf(desc, "Date %04d-%02d-%02d, UTC %02d:%02d",
+            year, month, day, fig_read(p, FIG0_10_HOURS),
+            fig_read(p, FIG0_10_MINUTES));
+
+    if (fig_read(p, FIG0_10_UTC_FLAG) && fig.len >= 7) {
+        n += sprintf(desc + n, ":%02d.%03d", fig_read(p, FIG0_10_SECONDS),
+                fig_read(p, FIG0_10_MS));
+    }
+    sprintf(desc + n, ", LSI=%d", fig_read(p, FIG0_10_LSI));
+    printbuf(desc, fig.indent+1, NULL, 0);
+}
+
+static void decode_fig0_13(const fig_t& fig)
+{
+    char desc[256];
+    const int pd = fig_read(fig.f, FIG0_PD);
+    int k = 1;
+
+    if (fig.len < (pd ? 6 : 4)) {
+        return;
+    }
+
+    // Programme services have a 16 bit SId, data services 32 bit
+    const uint32_t SId = fig_read(fig.f + k, pd ? SID_32 : SID_16);
+    k += pd ? 4 : 2;
+
+    const int No = fig_read(fig.f + k, FIG0_13_NUM);
+    sprintf(desc, "FIG %d/%d: SId=%u SCIdS=%u No=%u",
+            fig.type, fig.ext, SId, fig_read(fig.f + k, FIG0_13_SCIDS), No);
+    printbuf(desc, fig.indent+1, NULL, 0);
+    k++;
+
+    for (int numapp = 0; numapp < No && k + 2 <= fig.len; numapp++) {
+        const int user_app_type = fig_read(fig.f + k, FIG0_13_UA_TYPE);
+        const int user_app_len  = fig_read(fig.f + k, FIG0_13_UA_LEN);
+        k += 2 + user_app_len;
+
+        sprintf(desc, "User Application %d '%s'; length %u",
+                user_app_type,
+                get_fig_0_13_userapp(user_app_type).c_str(),
+                user_app_len);
+        printbuf(desc, fig.indent+2, NULL, 0);
+    }
+}
+
+static void decode_fig0_14(const fig_t& fig)
+{
+    char desc[256];
+
+    for (int k = 1; k < fig.len; k++) {
+        sprintf(desc, "SubChannel ID=%02X, FEC scheme=%d",
+                fig_read(fig.f + k, FIG0_14_SUBCHID),
+                fig_read(fig.f + k, FIG0_14_FEC));
+        printbuf(desc, fig.indent+1, NULL, 0);
+    }
+}
+
+static void decode_fig0_17(const fig_t& fig)
+{
+    char desc[256];
+
+    for (int k = 1; k + 4 <= fig.len;) {
+        const unsigned char* p = fig.f + k;
+        const int l_flag  = fig_read(p, FIG0_17_L);
+        const int cc_flag = fig_read(p, FIG0_17_CC);
+
+        int n = sprintf(desc, "Service ID=0x%04X, S/D=%d",
+                fig_read(p, FIG0_17_SID), fig_read(p, FIG0_17_SD));
+        k += 3;
+
+        if (l_flag) {
+            n += sprintf(desc + n, ", Language=0x%02X", fig.f[k]);
+            k++;
+        }
+
+        if (k < fig.len) {
+            n += sprintf(desc + n, ", International code=%d",
+                    fig_read(fig.f + k, FIG0_17_CODE));
+            k++;
+        }
+
+        if (cc_flag && k < fig.len) {
+            sprintf(desc + n, ", Complementary code=%d",
+                    fig_read(fig.f + k, FIG0_17_CODE));
+            k++;
+        }
+        printbuf(desc, fig.indent+1, NULL, 0);
+    }
+}
+
+static void decode_fig0_18(const fig_t& fig)
+{
+    char desc[256];
+
+    for (int k = 1; k + 5 <= fig.len;) {
+        const unsigned char* p = fig.f + k;
+        const int clusters = fig_read(p, FIG0_18_CLUSTERS);
+
+        int n = sprintf(desc, "Service ID=0x%04X, ASu flags=0x%04X, Clusters",
+                fig_read(p, FIG0_18_SID), fig_read(p, FIG0_18_ASU));
+        k += 5;
+
+        for (int c = 0; c < clusters && k < fig.len; c++, k++) {
+            n += sprintf(desc + n, " %d", fig.f[k]);
+        }
+        printbuf(desc, fig.indent+1, NULL, 0);
+    }
+}
+
+static void decode_fig1_header(const fig_t& fig)
+{
+    char desc[256];
+
+    sprintf(desc, "FIG %d/%d: OE=%d, Charset=%d",
+            fig.type, fig.ext, fig_read(fig.f, FIG1_OE),
+            fig_read(fig.f, FIG1_CHARSET));
+    printbuf(desc, fig.indent, fig.f+1, fig.len-1);
+}
+
+/* The label of a FIG 1 in UTF-8, and its character flag field */
+static uint16_t fig1_label(const fig_t& fig, char label[CHARSET_UTF8_SIZE(16)])
+{
+    if (fig.len < 19) {
+        label[0] = '\0';
+        return 0;
+    }
+
+    charset_to_utf8(label, fig.f + fig.len - 18, 16,
+            fig_read(fig.f, FIG1_CHARSET));
+    return (fig.f[fig.len-2] << 8) | fig.f[fig.len-1];
+}
+
+static void decode_fig1_0(const fig_t& fig)
+{
+    char desc[256];
+    char label[CHARSET_UTF8_SIZE(16)];
+    const uint16_t flag = fig1_label(fig, label);
+
+    sprintf(desc, "Ensemble ID 0x%04X label: \"%s\", Short label mask: 0x%04X",
+            fig_read(fig.f, FIG1_EID), label, flag);
+    printinfo(desc, fig.indent+1);
+}
+
+static void decode_fig1_1(const fig_t& fig)
+{
+    char desc[256];
+    char label[CHARSET_UTF8_SIZE(16)];
+    const uint16_t flag = fig1_label(fig, label);
+
+    sprintf(desc, "Service ID 0x%04X label: \"%s\", Short label mask: 0x%04X",
+            fig_read(fig.f, FIG1_SID_16), label, flag);
+    printinfo(desc, fig.indent+1);
+}
+
+static void decode_fig1_4(const fig_t& fig)
+{
+    char desc[256];
+    char label[CHARSET_UTF8_SIZE(16)];
+    const uint16_t flag = fig1_label(fig, label);
+    const int pd = fig_read(fig.f, FIG1_4_PD);
+
+    sprintf(desc,
+            "Service ID  0x%08X , Service Component ID 0x%04X Short, label: \"%s\", label mask: 0x%04X",
+            fig_read(fig.f, pd ? FIG1_4_SID_32 : FIG1_4_SID_16),
+            fig_read(fig.f, FIG1_4_SCIDS), label, flag);
+    printinfo(desc, fig.indent+1);
+}
+
+static void decode_fig1_5(const fig_t& fig)
+{
+    char desc[256];
+    char label[CHARSET_UTF8_SIZE(16)];
+    const uint16_t flag = fig1_label(fig, label);
+
+    sprintf(desc,
+            "Service ID 0x%08X label: \"%s\", Short label mask: 0x%04X",
+            fig_read(fig.f, FIG1_SID_32), label, flag);
+    printinfo(desc, fig.indent+1);
+}
+
+static void decode_fig1_6(const fig_t& fig)
+{
+    char desc[256];
+    char label[CHARSET_UTF8_SIZE(16)];
+    const uint16_t flag = fig1_label(fig, label);
+
+    // X-PAD User Application label
+    const int pd = fig_read(fig.f, FIG1_4_PD);
+    const int xpadapp = fig_read(fig.f,
+            pd ? FIG1_6_XPADAPP_32 : FIG1_6_XPADAPP_16);
+
+    const char* xpadappdesc = "?";
+    if (xpadapp == 2) {
+        xpadappdesc = "DLS";
     }
+    else if (xpadapp == 12) {
+        xpadappdesc = "MOT";
+    }
+
+    sprintf(desc,"Service ID  0x%08X , Service Component ID 0x%04X Short, X-PAD App %02X (%s), label: \"%s\", label mask: 0x%04X",
+            fig_read(fig.f, pd ? FIG1_4_SID_32 : FIG1_4_SID_16),
+            fig_read(fig.f, FIG1_4_SCIDS), xpadapp, xpadappdesc, label, flag);
+    printbuf(desc,fig.indent+1,NULL,0,"");
+}
+
+static void decode_fig2_header(const fig_t& fig)
+{
+    char desc[256];
+
+    sprintf(desc, "FIG %d/%d: Toggle=%d, OE=%d, Segment_index=%d",
+            fig.type, fig.ext, fig_read(fig.f, FIG2_TOGGLE),
+            fig_read(fig.f, FIG2_OE), fig_read(fig.f, FIG2_SEGMENT));
+    printbuf(desc, fig.indent, fig.f+1, fig.len-1);
 }
 
+static void decode_fig5_header(const fig_t& fig)
+{
+    char desc[256];
+
+    sprintf(desc, "FIG %d/%d: D1=%d, D2=%d, TCId=%d",
+            fig.type, fig.ext, fig_read(fig.f, FIG5_D1),
+            fig_read(fig.f, FIG5_D2), fig_read(fig.f, FIG5_TCID));
+    printbuf(desc, fig.indent, fig.f+1, fig.len-1);
+}
+
+static void decode_fig6(const fig_t& fig)
+{
+    // Conditional access
+    fprintf(stderr, "ERROR: ETI contains unsupported FIG 6");
+}
+
+/* The decoders of each FIG type and extension. The entry with extension
+ * -1 decodes the type specific header, and is called before the one of
+ * the extension. min_verb is the verbosity from which they print. */
+struct fig_registry_entry_t {
+    int type;
+    int ext;
+    int min_verb;
+    fig_decoder_t decode;
+};
+
+static const fig_registry_entry_t fig_registry[] = {
+    {0, -1, 1, decode_fig0_header},
+    {0,  0, 1, decode_fig0_0},
+    {0,  1, 1, decode_fig0_1},
+    {0,  2, 1, decode_fig0_2},
+    {0,  3, 1, decode_fig0_3},
+    {0,  5, 1, decode_fig0_5},
+    {0,  8, 1, decode_fig0_8},
+    {0,  9, 1, decode_fig0_9},
+    {0, 10, 1, decode_fig0_10},
+    {0, 13, 1, decode_fig0_13},
+    {0, 14, 1, decode_fig0_14},
+    {0, 17, 1, decode_fig0_17},
+    {0, 18, 1, decode_fig0_18},
+    {1, -1, 1, decode_fig1_header},
+    {1,  0, 0, decode_fig1_0},
+    {1,  1, 0, decode_fig1_1},
+    {1,  4, 0, decode_fig1_4},
+    {1,  5, 0, decode_fig1_5},
+    {1,  6, 1, decode_fig1_6},
+    {2, -1, 1, decode_fig2_header},
+    {5, -1, 1, decode_fig5_header},
+    {6, -1, 0, decode_fig6},
+};
+
+/* The registry as a table indexed by type and extension + 1 */
+class FIGDecoderTable
+{
+    public:
+        FIGDecoderTable()
+        {
+            memset(m_entries, 0, sizeof(m_entries));
+
+            const size_t n = sizeof(fig_registry) / sizeof(fig_registry[0]);
+            for (size_t i = 0; i < n; i++) {
+                const fig_registry_entry_t& e = fig_registry[i];
+                m_entries[e.type][e.ext + 1] = &e;
+            }
+        }
+
+        void decode(const fig_t& fig) const
+        {
+            const fig_registry_entry_t* header = m_entries[fig.type][0];
+            if (header && verbosity >= header->min_verb) {
+                header->decode(fig);
+            }
+
+            if (fig.ext >= 0) {
+                const fig_registry_entry_t* e =
+                    m_entries[fig.type][fig.ext + 1];
+                if (e && verbosity >= e->min_verb) {
+                    e->decode(fig);
+                }
+            }
+        }
+
+    private:
+        const fig_registry_entry_t* m_entries[8][33];
+};
+
+static const FIGDecoderTable fig_decoders;
+
+void decodeFIG(const unsigned char* f,
+               unsigned char figlen,
+               unsigned short int figtype,
+               unsigned short int indent)
+{
+    const fig_t fig = {f, figlen, figtype, fig_extension(f, figtype), indent};
+    fig_decoders.decode(fig);
+}
+
+/* The extension of the FIG, or -1 for the FIG types that have none */
+int fig_extension(const unsigned char* f, unsigned short int figtype)
+{
+    switch (figtype) {
+        case 0:
+            return f[0] & 0x1F;
+        case 1:
+        case 2:
+        case 5:
+            return f[0] & 0x07;
+        default:
+            return -1;
+    }
+}
 
-void printinfo(string header,
+void printinfo(const char* header,
         int indent_level,
         int min_verb)
 {
     if (verbosity >= min_verb) {
         for (int i = 0; i < indent_level; i++) {
-            printf("\t");
+            fprintf(analysis_out, "\t");
         }
-        printf("%s\n", header.c_str());
+        fprintf(analysis_out, "%s\n", header);
     }
 }
 
-void printbuf(string header,
+void printbuf(const char* header,
         int indent_level,
-        unsigned char* buffer,
+        const unsigned char* buffer,
         size_t size,
-        string desc)
+        const char* desc)
 {
     if (verbosity > 0) {
         for (int i = 0; i < indent_level; i++) {
-            printf("\t");
+            fprintf(analysis_out, "\t");
         }
 
-        printf("%s", header.c_str());
+        fprintf(analysis_out, "%s", header);
 
         if (verbosity > 1) {
             if (size != 0) {
-                printf(": ");
+                fprintf(analysis_out, ": ");
             }
 
             for (size_t i = 0; i < size; i++) {
-                printf("%02x ", buffer[i]);
+                fprintf(analysis_out, "%02x ", buffer[i]);
             }
         }
 
-        if (desc != "") {
-            printf(" [%s] ", desc.c_str());
+        if (desc[0] != '\0') {
+            fprintf(analysis_out, " [%s] ", desc);
         }
 
-        printf("\n");
+        fprintf(analysis_out, "\n");
     }
 }
 
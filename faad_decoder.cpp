@@ -28,17 +28,78 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <cassert>
 #include <string>
 #include <sstream>
 #include <vector>
+#include <mutex>
 
 using namespace std;
 
+/* The initialised decoders given back by FaadHandles, by audio
+ * parameters, closed at exit */
+class FaadHandlePool
+{
+    public:
+        ~FaadHandlePool()
+        {
+            for (size_t i = 0; i < decoders.size(); i++) {
+                NeAACDecClose(decoders[i].second);
+            }
+        }
+
+        std::mutex mutex;
+        std::vector<std::pair<int, NeAACDecHandle> > decoders;
+};
+
+static FaadHandlePool& faad_pool()
+{
+    static FaadHandlePool pool;
+    return pool;
+}
+
+int faad_config_key(bool ps_flag, bool aac_channel_mode, bool dac_rate,
+        bool sbr_flag, int mpeg_surround_config)
+{
+    return (mpeg_surround_config << 4) | (sbr_flag << 3) |
+        (dac_rate << 2) | (aac_channel_mode << 1) | ps_flag;
+}
+
+NeAACDecHandle faad_pool_get(int config, bool* initialised)
+{
+    FaadHandlePool& pool = faad_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+
+    for (size_t i = pool.decoders.size(); i-- > 0;) {
+        if (pool.decoders[i].first == config) {
+            NeAACDecHandle decoder = pool.decoders[i].second;
+            pool.decoders.erase(pool.decoders.begin() + i);
+            *initialised = true;
+            return decoder;
+        }
+    }
+
+    *initialised = false;
+    return NeAACDecOpen();
+}
+
+void faad_pool_put(NeAACDecHandle decoder, int config)
+{
+    // Forget the previous stream like after a seek, the next user
+    // continues with the same audio parameters
+    NeAACDecPostSeekReset(decoder, 0);
+
+    FaadHandlePool& pool = faad_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.decoders.push_back(std::make_pair(config, decoder));
+}
+
 FaadDecoder::FaadDecoder() :
     m_data_len(0),
-    m_fd(NULL),
-    m_aac(NULL),
+    m_wav_rate(0),
+    m_write_aac(true),
+    m_write_wav(true),
+    m_write_pcm(false),
+    m_open(false),
     m_initialised(false)
 {
 }
@@ -53,13 +114,58 @@ void FaadDecoder::open(string filename, bool ps_flag, bool aac_channel_mode,
     m_sbr_flag             = sbr_flag;
     m_mpeg_surround_config = mpeg_surround_config;
 
-    stringstream ss;
-    ss << filename << ".aac";
+    if (m_write_aac) {
+        open_output(m_aac, m_aac_target, ".aac");
+    }
+
+    m_open = true;
+}
+
+void FaadDecoder::set_audio_params(bool ps_flag, bool aac_channel_mode,
+        bool dac_rate, bool sbr_flag, int mpeg_surround_config)
+{
+    if (m_ps_flag != ps_flag ||
+            m_aac_channel_mode != aac_channel_mode ||
+            m_dac_rate != dac_rate ||
+            m_sbr_flag != sbr_flag ||
+            m_mpeg_surround_config != mpeg_surround_config) {
+        m_ps_flag              = ps_flag;
+        m_aac_channel_mode     = aac_channel_mode;
+        m_dac_rate             = dac_rate;
+        m_sbr_flag             = sbr_flag;
+        m_mpeg_surround_config = mpeg_surround_config;
+
+        reset();
+    }
+}
+
+void FaadDecoder::reset()
+{
+    m_faad_handle.close();
+    m_initialised = false;
+}
+
+bool FaadDecoder::open_output(OutputFile& output, const string& target,
+        const char* extension)
+{
+    bool ok;
+
+    if (target.empty()) {
+        stringstream ss;
+        ss << m_filename << extension;
+        ok = output.open(ss.str());
+    }
+    else {
+        ok = output.open_target(target);
+    }
 
-    m_aac = fopen(ss.str().c_str(), "w");
+    if (!ok) {
+        perror("File open failed");
+    }
+    return ok;
 }
 
-bool FaadDecoder::decode(vector<vector<uint8_t> > aus)
+int FaadDecoder::decode(const aac_au_t* aus, int num_aus)
 {
     /* ADTS header creation taken from SDR-J */
     adts_fixed_header fh;
@@ -120,112 +226,178 @@ bool FaadDecoder::decode(vector<vector<uint8_t> > aus)
     }
     else {
         printf("Unrecognized mpeg surround config (ignored)\n");
-        return false;
+        return num_aus;
     }
 
     setBits (&d_header[2], fh.channel_conf, 7, 3);
 
-    for (size_t au_ix = 0; au_ix < aus.size(); au_ix++) {
+    int errors = 0;
+    for (int au_ix = 0; au_ix < num_aus; au_ix++) {
 
-        vector<uint8_t>& au = aus[au_ix];
-
-        uint8_t helpBuffer[960];
-        memset(helpBuffer, 0, sizeof(helpBuffer));
+        const aac_au_t& au = aus[au_ix];
 
         // Set length in header (header + au)
-        vh.aac_frame_length = 7 + au.size();
+        vh.aac_frame_length = ADTS_HEADER_SIZE + au.size;
         setBits(&d_header[3], vh.aac_frame_length, 6, 13);
 
-        memcpy(helpBuffer, d_header, 7 * sizeof(uint8_t));
-        memcpy(&helpBuffer[7],
-                &au[0], au.size() * sizeof (uint8_t));
+        // Put the header in front of the AU, in place of the
+        // superframe bytes that are there
+        uint8_t* adts_frame = au.data - ADTS_HEADER_SIZE;
+        uint8_t saved[ADTS_HEADER_SIZE];
+        memcpy(saved, adts_frame, ADTS_HEADER_SIZE);
+        memcpy(adts_frame, d_header, ADTS_HEADER_SIZE);
 
-        fwrite(helpBuffer, 1, vh.aac_frame_length, m_aac);
+        bool ok = decode_frame(adts_frame, vh.aac_frame_length);
 
-        NeAACDecFrameInfo hInfo;
-        int16_t* outBuffer;
+        memcpy(adts_frame, saved, ADTS_HEADER_SIZE);
 
-        if (!m_initialised) {
-            long unsigned samplerate;
-            unsigned char channels;
+        if (!ok) {
+            errors++;
+        }
+    }
+    return errors;
+}
 
-            int len;
+bool FaadDecoder::decode_frame(uint8_t* adts_frame, size_t length)
+{
+    if (m_aac.is_open()) {
+        m_aac.write(adts_frame, length);
+    }
 
-            if ((len = NeAACDecInit(m_faad_handle.decoder, helpBuffer,
-                            vh.aac_frame_length, &samplerate, &channels)) < 0)
-            {
-                /* If some error initializing occured, skip the file */
-                printf("Error initializing decoder library (%d).\n",
-                        len);
-                NeAACDecClose(m_faad_handle.decoder);
-                return false;
-            }
+    if (!m_write_wav && !m_write_pcm) {
+        return true;
+    }
 
-            m_initialised = true;
+    NeAACDecFrameInfo hInfo;
+    int16_t* outBuffer;
 
-            outBuffer = (int16_t *)NeAACDecDecode(
-                    m_faad_handle.decoder, &hInfo,
-                    helpBuffer + len, vh.aac_frame_length - len );
-        }
-        else {
-            outBuffer = (int16_t *)NeAACDecDecode(
-                    m_faad_handle.decoder, &hInfo,
-                    helpBuffer, vh.aac_frame_length );
+    if (!m_initialised) {
+        // A decoder from the pool was already initialised for the same
+        // audio parameters, and must not be initialised again
+        const int config = faad_config_key(m_ps_flag, m_aac_channel_mode,
+                m_dac_rate, m_sbr_flag, m_mpeg_surround_config);
+        m_faad_handle.get(config);
+        m_initialised = m_faad_handle.initialised;
+    }
+
+    if (!m_initialised) {
+        long unsigned samplerate;
+        unsigned char channels;
+
+        int len;
+
+        if ((len = NeAACDecInit(m_faad_handle.decoder, adts_frame,
+                        length, &samplerate, &channels)) < 0)
+        {
+            /* If some error initializing occured, skip the file */
+            printf("Error initializing decoder library (%d).\n",
+                    len);
+            m_faad_handle.close();
+            return false;
         }
 
-        assert(outBuffer != NULL);
+        m_faad_handle.initialised = true;
+        m_initialised = true;
 
-        m_sample_rate = hInfo.samplerate;
-        m_channels    = hInfo.channels;
-        size_t samples  = hInfo.samples;
+        outBuffer = (int16_t *)NeAACDecDecode(
+                m_faad_handle.decoder, &hInfo,
+                adts_frame + len, length - len );
+    }
+    else {
+        outBuffer = (int16_t *)NeAACDecDecode(
+                m_faad_handle.decoder, &hInfo,
+                adts_frame, length );
+    }
+
+    // libfaad returns no samples when it sets the error
+    if (hInfo.error != 0 || outBuffer == NULL) {
+        printf("FAAD Warning: %s\n",
+                faacDecGetErrorMessage(hInfo.error));
+        return false;
+    }
+
+    m_sample_rate = hInfo.samplerate;
+    m_channels    = hInfo.channels;
+    size_t samples  = hInfo.samples;
 
 #if 0
-        printf("bytes consumed %d\n", (int)(hInfo.bytesconsumed));
-        printf("samplerate = %d, samples = %zu, channels = %d,"
-                " error = %d, sbr = %d\n", m_sample_rate, samples,
-                m_channels, hInfo.error, hInfo.sbr);
-        printf("header = %d\n", hInfo.header_type);
+    printf("bytes consumed %d\n", (int)(hInfo.bytesconsumed));
+    printf("samplerate = %d, samples = %zu, channels = %d,"
+            " error = %d, sbr = %d\n", m_sample_rate, samples,
+            m_channels, hInfo.error, hInfo.sbr);
+    printf("header = %d\n", hInfo.header_type);
 #endif
 
-        if (hInfo.error != 0) {
-            printf("FAAD Warning: %s\n",
-                    faacDecGetErrorMessage(hInfo.error));
+    if (m_write_wav && !m_wav.is_open()) {
+        if (!open_output(m_wav, m_wav_target, ".wav")) {
             return false;
         }
 
-        if (m_fd == NULL) {
-            stringstream ss;
-            ss << m_filename << ".wav";
-            m_fd = wavfile_open(ss.str().c_str(), m_sample_rate);
+        // On a file, the lengths are filled in by close(). A pipe gets
+        // a header that does not need them.
+        char header[WAVFILE_HEADER_SIZE];
+        wavfile_header(header, m_sample_rate,
+                m_wav.is_seekable() ? 0 : WAVFILE_UNKNOWN_LENGTH);
+        m_wav.write(header, sizeof(header));
+        m_wav_rate = m_sample_rate;
+    }
+
+    if (m_write_pcm && !m_pcm.is_open()) {
+        if (!open_output(m_pcm, m_pcm_target, ".pcm")) {
+            return false;
         }
+    }
 
-        if (samples) {
-            if (m_channels == 1) {
-                int16_t *buffer = (int16_t *)alloca (2 * samples);
-                size_t i;
-                for (i = 0; i < samples; i ++) {
-                    buffer [2 * i]  = ((int16_t *)outBuffer) [i];
-                    buffer [2 * i + 1] = buffer [2 * i];
-                }
-                wavfile_write(m_fd, buffer, 2*samples);
-            }
-            else if (m_channels == 2) {
-                wavfile_write(m_fd, outBuffer, samples);
+    if (samples) {
+        if (m_channels == 1 || m_channels == 2) {
+            if (m_wav.is_open()) {
+                write_samples(m_wav, outBuffer, samples);
             }
-            else {
-                printf("Cannot handle %d channels\n", m_channels);
+            if (m_pcm.is_open()) {
+                write_samples(m_pcm, outBuffer, samples);
             }
         }
-
+        else {
+            printf("Cannot handle %d channels\n", m_channels);
+        }
     }
     return true;
 }
 
+/* Write 16-bit stereo samples, duplicating mono samples directly
+ * into the output buffer */
+void FaadDecoder::write_samples(OutputFile& output, const int16_t* samples,
+        size_t num_samples)
+{
+    if (m_channels == 1) {
+        const size_t len = 2 * num_samples * sizeof(int16_t);
+        int16_t *buffer = (int16_t *)output.reserve(len);
+        size_t i;
+        for (i = 0; i < num_samples; i ++) {
+            buffer [2 * i]  = samples [i];
+            buffer [2 * i + 1] = buffer [2 * i];
+        }
+        output.commit(len);
+    }
+    else {
+        output.write(samples, num_samples * sizeof(int16_t));
+    }
+}
+
 void FaadDecoder::close()
 {
-    if (m_initialised) {
-        wavfile_close(m_fd);
+    if (m_wav.is_open() && m_wav.is_seekable()) {
+        char header[WAVFILE_HEADER_SIZE];
+        wavfile_header(header, m_wav_rate,
+                m_wav.size() - WAVFILE_HEADER_SIZE);
+        m_wav.write_at(0, header, sizeof(header));
     }
+
+    m_wav.close();
+    m_aac.close();
+    m_pcm.close();
+
+    m_faad_handle.close();
 }
 
 
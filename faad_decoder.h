@@ -29,6 +29,7 @@
 #include <sstream>
 #include <vector>
 #include <neaacdec.h>
+#include "outputfile.h"
 
 #ifndef __FAAD_DECODER_H_
 #define __FAAD_DECODER_H_
@@ -54,55 +55,170 @@ struct adts_variable_header {
     unsigned int no_raw_data_blocks     :2;
 };
 
+#define ADTS_HEADER_SIZE 7
+
+/* An access unit inside a superframe. The ADTS_HEADER_SIZE bytes before
+ * data must be writable, FaadDecoder::decode() puts the ADTS header there
+ * and restores them afterwards. */
+struct aac_au_t {
+    uint8_t* data;
+    size_t size;
+};
+
+/* The audio parameters a libfaad decoder was initialised for, see
+ * FaadDecoder::set_audio_params() */
+int faad_config_key(bool ps_flag, bool aac_channel_mode, bool dac_rate,
+        bool sbr_flag, int mpeg_surround_config);
+
+/* Take a decoder initialised for the config from the pool, setting
+ * initialised. If there is none, open a new one that still needs
+ * NeAACDecInit() */
+NeAACDecHandle faad_pool_get(int config, bool* initialised);
+
+/* Keep an initialised decoder in the pool for the next faad_pool_get()
+ * with the same config */
+void faad_pool_put(NeAACDecHandle decoder, int config);
+
+/* The libfaad decoder is only taken from the pool once get() is called,
+ * so that nothing is initialised in the library when no audio is
+ * decoded. libfaad cannot initialise a decoder a second time, so the
+ * pool is keyed by the audio parameters: close() gives an initialised
+ * decoder back for reuse with the same parameters, and closes one that
+ * was never initialised. */
 class FaadHandle
 {
     public:
-        FaadHandle()
-        {
-            decoder = NeAACDecOpen();
-        }
+        FaadHandle() : decoder(NULL), config(-1), initialised(false) {}
 
-        FaadHandle(const FaadHandle& other)
+        FaadHandle(FaadHandle&& other) :
+            decoder(other.decoder),
+            config(other.config),
+            initialised(other.initialised)
         {
-            this->decoder = NeAACDecOpen();
+            other.decoder = NULL;
+            other.initialised = false;
         }
 
-        FaadHandle& operator=(const FaadHandle& other)
+        FaadHandle& operator=(FaadHandle&& other)
         {
-            this->decoder = NeAACDecOpen();
+            if (this != &other) {
+                close();
+                decoder = other.decoder;
+                config = other.config;
+                initialised = other.initialised;
+                other.decoder = NULL;
+                other.initialised = false;
+            }
             return *this;
         }
 
         ~FaadHandle()
         {
-            NeAACDecClose(decoder);
-            decoder = NULL;
+            close();
+        }
+
+        NeAACDecHandle get(int new_config)
+        {
+            if (decoder == NULL) {
+                config = new_config;
+                decoder = faad_pool_get(config, &initialised);
+            }
+            return decoder;
+        }
+
+        void close(void)
+        {
+            if (decoder) {
+                if (initialised) {
+                    faad_pool_put(decoder, config);
+                }
+                else {
+                    NeAACDecClose(decoder);
+                }
+                decoder = NULL;
+                initialised = false;
+            }
         }
 
         NeAACDecHandle decoder;
+
+        // The audio parameters of the decoder, and whether
+        // NeAACDecInit() was called for them
+        int config;
+        bool initialised;
+
+    private:
+        FaadHandle(const FaadHandle& other);
+        FaadHandle& operator=(const FaadHandle& other);
 };
 
 class FaadDecoder
 {
     public:
         FaadDecoder();
+        FaadDecoder(FaadDecoder&& other) = default;
+        FaadDecoder& operator=(FaadDecoder&& other) = default;
 
         void open(std::string filename, bool ps_flag, bool aac_channel_mode,
                 bool dac_rate, bool sbr_flag, int mpeg_surround_config);
 
+        /* Change the audio parameters of an open decoder. If they are
+         * different, the decoder is reinitialised with the next AU */
+        void set_audio_params(bool ps_flag, bool aac_channel_mode,
+                bool dac_rate, bool sbr_flag, int mpeg_surround_config);
+
+        /* Start decoding again from the next AU, keeping the outputs */
+        void reset(void);
+
         void close(void);
 
-        bool decode(std::vector<std::vector<uint8_t> > aus);
+        /* Select which of the .aac, .wav and .pcm files get written.
+         * Without the .wav and .pcm, the AUs are not decoded */
+        void set_outputs(bool write_aac, bool write_wav, bool write_pcm)
+        {
+            m_write_aac = write_aac;
+            m_write_wav = write_wav;
+            m_write_pcm = write_pcm;
+        }
 
+        /* Where to write each output instead of the file named after
+         * open()'s filename, as accepted by OutputFile::open_target().
+         * Empty for the default file */
+        void set_targets(const std::string& aac_target,
+                const std::string& wav_target, const std::string& pcm_target)
+        {
+            m_aac_target = aac_target;
+            m_wav_target = wav_target;
+            m_pcm_target = pcm_target;
+        }
+
+        /* Decode all AUs of a superframe, also those after one that
+         * fails. Returns the number of AUs that could not be decoded */
+        int decode(const aac_au_t* aus, int num_aus);
+
+        bool is_open(void) { return m_open; }
         bool is_initialised(void) { return m_initialised; }
 
     private:
+        FaadDecoder(const FaadDecoder& other);
+        FaadDecoder& operator=(const FaadDecoder& other);
+
+        bool decode_frame(uint8_t* adts_frame, size_t length);
+        bool open_output(OutputFile& output, const std::string& target,
+                const char* extension);
+        void write_samples(OutputFile& output, const int16_t* samples,
+                size_t num_samples);
         void update_header(void);
         size_t m_data_len;
 
         std::string m_filename;
-        FILE* m_fd;
-        FILE* m_aac;
+        OutputFile m_wav;
+        OutputFile m_aac;
+        OutputFile m_pcm;
+
+        std::string m_aac_target;
+        std::string m_wav_target;
+        std::string m_pcm_target;
 
         /* Data needed for FAAD */
         bool m_ps_flag;
@@ -114,6 +230,14 @@ class FaadDecoder
         int  m_channels;
         int  m_sample_rate;
 
+        // Sample rate written in the .wav header
+        int  m_wav_rate;
+
+        bool m_write_aac;
+        bool m_write_wav;
+        bool m_write_pcm;
+
+        bool m_open;
         bool m_initialised;
         FaadHandle m_faad_handle;
 };
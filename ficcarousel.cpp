@@ -0,0 +1,279 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    ficcarousel.cpp
+         Repetition rates of the FIGs in the FIC carousel
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "ficcarousel.h"
+
+using namespace std;
+
+/* The repetition rate class of EN 300 401 for the FIG, and the longest
+ * allowed interval between two repetitions in ms. Returns 0 for the
+ * FIGs that have no rate to check. */
+static char carousel_rate_class(int type, int ext, int* max_interval)
+{
+    char rate = 0;
+
+    if (type == 0) {
+        switch (ext) {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+            case 14:
+            case 19:
+                rate = 'A';
+                break;
+            case 5:
+            case 8:
+            case 9:
+            case 10:
+            case 13:
+            case 17:
+            case 18:
+                rate = 'B';
+                break;
+            case 6:
+            case 21:
+            case 24:
+                rate = 'E';
+                break;
+        }
+    }
+    else if (type == 1) {
+        rate = 'B';
+    }
+
+    switch (rate) {
+        case 'A': *max_interval = 100; break;
+        case 'B': *max_interval = 1000; break;
+        case 'E': *max_interval = 120000; break;
+    }
+    return rate;
+}
+
+FICCarouselAnalyser::FICCarouselAnalyser() :
+    m_interval(0),
+    m_frame(0),
+    m_second(0),
+    m_bad_fibs(0)
+{
+    memset(m_fib_frames, 0, sizeof(m_fib_frames));
+    memset(m_fib_bytes, 0, sizeof(m_fib_bytes));
+    memset(m_fib_peak, 0, sizeof(m_fib_peak));
+}
+
+carousel_fig_t& FICCarouselAnalyser::get_fig(int type, int ext, long sid)
+{
+    const uint64_t key = ((uint64_t)type << 40) | ((uint64_t)ext << 33) |
+        ((uint64_t)(sid != -1) << 32) | (uint32_t)sid;
+
+    map<uint64_t, carousel_fig_t>::iterator it = m_figs.find(key);
+    if (it != m_figs.end()) {
+        return it->second;
+    }
+
+    carousel_fig_t& fig = m_figs[key];
+    memset(fig.counts, 0, sizeof(fig.counts));
+    fig.type = type;
+    fig.ext = ext;
+    fig.sid = sid;
+    fig.total = 0;
+    fig.last_seen = -1;
+    fig.max_gap = 0;
+    return fig;
+}
+
+bool FICCarouselAnalyser::update_frame(const EtiFrame& frame)
+{
+    const long second = m_frame * CAROUSEL_FRAME_MS / 1000;
+
+    // Clear the seconds of the ring buffers that start again
+    if (second != m_second) {
+        for (map<uint64_t, carousel_fig_t>::iterator it = m_figs.begin();
+                it != m_figs.end(); ++it) {
+            for (long s = m_second + 1;
+                    s <= second && s <= m_second + CAROUSEL_SLOTS; s++) {
+                it->second.counts[s % CAROUSEL_SLOTS] = 0;
+            }
+        }
+        m_second = second;
+    }
+
+    const size_t num_fibs = min(frame.fic_length / 32,
+            (size_t)CAROUSEL_MAX_FIBS);
+    bool fib_ok[CAROUSEL_MAX_FIBS];
+    int used[CAROUSEL_MAX_FIBS];
+
+    for (size_t fib = 0; fib < num_fibs; fib++) {
+        fib_ok[fib] = eti_frame_fib_crc_ok(frame, fib);
+        used[fib] = 0;
+        if (!fib_ok[fib]) {
+            m_bad_fibs++;
+        }
+    }
+
+    size_t pos = 0;
+    const uint8_t* fig;
+    while ((fig = eti_frame_next_fig(frame, &pos)) != NULL) {
+        const size_t fib = (fig - frame.fic) / 32;
+        if (fib >= num_fibs || !fib_ok[fib]) {
+            continue;
+        }
+
+        const int type = (fig[0] & 0xE0) >> 5;
+        const int len  =  fig[0] & 0x1F;
+        const uint8_t* f = fig + 1;
+        used[fib] += len + 1;
+
+        if (len < 1) {
+            continue;
+        }
+
+        int ext;
+        long sid = -1;
+        if (type == 0) {
+            ext = f[0] & 0x1F;
+        }
+        else {
+            ext = f[0] & 0x07;
+        }
+
+        if (type == 1) {
+            if (ext == 1 && len >= 3) {
+                sid = (f[1] << 8) | f[2];
+            }
+            else if (ext == 4 && len >= 4) {
+                if (f[1] & 0x80) {
+                    sid = len >= 6 ? (long)(((uint32_t)f[2] << 24) |
+                            (f[3] << 16) | (f[4] << 8) | f[5]) : -1;
+                }
+                else {
+                    sid = (f[2] << 8) | f[3];
+                }
+            }
+            else if (ext == 5 && len >= 5) {
+                sid = (long)(((uint32_t)f[1] << 24) |
+                        (f[2] << 16) | (f[3] << 8) | f[4]);
+            }
+        }
+
+        carousel_fig_t& entry = get_fig(type, ext, sid);
+
+        // Several repetitions in the same frame are not a gap
+        if (entry.last_seen != -1 && entry.last_seen != m_frame) {
+            entry.max_gap = max(entry.max_gap, m_frame - entry.last_seen);
+        }
+        entry.last_seen = m_frame;
+        entry.total++;
+        entry.counts[second % CAROUSEL_SLOTS]++;
+    }
+
+    for (size_t fib = 0; fib < num_fibs; fib++) {
+        if (fib_ok[fib]) {
+            m_fib_frames[fib]++;
+            m_fib_bytes[fib] += used[fib];
+            m_fib_peak[fib] = max(m_fib_peak[fib], used[fib]);
+        }
+    }
+
+    m_frame++;
+
+    return m_interval > 0 && m_frame % m_interval == 0;
+}
+
+double FICCarouselAnalyser::rate(const carousel_fig_t& fig, int window) const
+{
+    // Only the complete seconds
+    if (m_second < window) {
+        return -1;
+    }
+
+    long count = 0;
+    for (long s = m_second - window; s < m_second; s++) {
+        count += fig.counts[s % CAROUSEL_SLOTS];
+    }
+    return (double)count / window;
+}
+
+void FICCarouselAnalyser::print(FILE* out) const
+{
+    static const int windows[3] = {1, 10, CAROUSEL_SECONDS};
+
+    fprintf(out, "FIC carousel after %.1f s, repetitions per second\n",
+            m_frame * CAROUSEL_FRAME_MS / 1000.0);
+    fprintf(out, "\tFIG   SId         %8s %8s %8s  %9s  %s\n",
+            "1 s", "10 s", "60 s", "max gap", "rate");
+
+    for (map<uint64_t, carousel_fig_t>::const_iterator it = m_figs.begin();
+            it != m_figs.end(); ++it) {
+        const carousel_fig_t& fig = it->second;
+        char sid[16] = "";
+        char rates[3][16];
+        char rate_desc[32] = "";
+
+        if (fig.sid != -1) {
+            sprintf(sid, "0x%04lX", fig.sid);
+        }
+
+        for (int w = 0; w < 3; w++) {
+            const double r = rate(fig, windows[w]);
+            if (r < 0) {
+                sprintf(rates[w], "-");
+            }
+            else {
+                sprintf(rates[w], "%.1f", r);
+            }
+        }
+
+        // Include the time since the last repetition
+        const long gap = max(fig.max_gap, m_frame - fig.last_seen);
+        const long gap_ms = gap * CAROUSEL_FRAME_MS;
+
+        int max_interval;
+        const char rate_class = carousel_rate_class(fig.type, fig.ext,
+                &max_interval);
+        if (rate_class) {
+            sprintf(rate_desc, "%c %s", rate_class,
+                    gap_ms <= max_interval ? "OK" : "too slow");
+        }
+
+        fprintf(out, "\t%d/%-2d  %-10s  %8s %8s %8s  %6ld ms  %s\n",
+                fig.type, fig.ext, sid, rates[0], rates[1], rates[2],
+                gap_ms, rate_desc);
+    }
+
+    for (size_t fib = 0; fib < CAROUSEL_MAX_FIBS; fib++) {
+        if (m_fib_frames[fib]) {
+            fprintf(out, "\tFIB %zu: %.1f%% used on average, "
+                    "%.1f%% at most\n", fib,
+                    100.0 * m_fib_bytes[fib] / (m_fib_frames[fib] * 30),
+                    100.0 * m_fib_peak[fib] / 30);
+        }
+    }
+
+    if (m_bad_fibs) {
+        fprintf(out, "\t%ld FIBs with a CRC error\n", m_bad_fibs);
+    }
+}
+
@@ -0,0 +1,104 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    ficcarousel.h
+         Repetition rates of the FIGs in the FIC carousel
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include "etiframe.h"
+
+#ifndef __FICCAROUSEL_H_
+#define __FICCAROUSEL_H_
+
+// Duration of an ETI frame
+#define CAROUSEL_FRAME_MS 24
+
+// The repetitions are counted per second over the longest window
+#define CAROUSEL_SECONDS 60
+
+// The ring buffer also holds the current second, which is not complete
+#define CAROUSEL_SLOTS (CAROUSEL_SECONDS + 1)
+
+// Mode III has the most FIBs per frame
+#define CAROUSEL_MAX_FIBS 4
+
+struct carousel_fig_t {
+    int type;
+    int ext;
+    long sid;            // for the labels of FIG 1/1, 1/4 and 1/5, or -1
+
+    // Repetitions in each second, a ring buffer by second
+    uint32_t counts[CAROUSEL_SLOTS];
+
+    long total;
+    long last_seen;      // frame
+    long max_gap;        // in frames, between two repetitions
+};
+
+/* Statistics of the FIC carousel over all frames given to update_frame():
+ * the repetition rate of each FIG type and extension, and for the labels
+ * of each SId, over sliding windows of 1, 10 and 60 seconds, the longest
+ * gap between two repetitions compared to the repetition rate EN 300 401
+ * requires, and how full the FIBs are. FIBs with a wrong CRC are not
+ * counted.
+ */
+class FICCarouselAnalyser
+{
+    public:
+        FICCarouselAnalyser();
+
+        /* Print the summary every interval frames from update_frame(),
+         * 0 for never */
+        void set_interval(long interval) { m_interval = interval; }
+
+        /* Update with all FIGs of the frame. Returns true when a summary
+         * is due */
+        bool update_frame(const EtiFrame& frame);
+
+        void print(FILE* out) const;
+
+    private:
+        carousel_fig_t& get_fig(int type, int ext, long sid);
+
+        // Repetitions of the entry over the last window seconds, -1 if
+        // not enough seconds have passed
+        double rate(const carousel_fig_t& fig, int window) const;
+
+        long m_interval;
+
+        // Number of frames given to update_frame(), and the current second
+        long m_frame;
+        long m_second;
+
+        long m_bad_fibs;
+
+        // FIB use in bytes, including the FIG headers
+        long m_fib_frames[CAROUSEL_MAX_FIBS];
+        long m_fib_bytes[CAROUSEL_MAX_FIBS];
+        int m_fib_peak[CAROUSEL_MAX_FIBS];
+
+        // By type, extension and SId, so that the summary is in order
+        std::map<uint64_t, carousel_fig_t> m_figs;
+};
+
+#endif
+
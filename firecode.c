@@ -23,28 +23,75 @@
 
 #include "firecode.h"
 
-uint16_t firecode_crc(uint8_t* buf, size_t size)
+#define FIRECODE_POLY 0x782F // 0111 1000 0010 1111 (16, 14, 13, 12, 11, 5, 3, 2, 1, 0)
+
+/* firecode_tab[b] is the CRC of byte b, firecode_out_tab[b] the CRC of
+ * byte b followed by FIRECODE_LENGTH zero bytes, which is what the byte
+ * leaving the window contributes once the window has moved by one */
+static uint16_t firecode_tab[256];
+static uint16_t firecode_out_tab[256];
+
+static inline uint16_t firecode_update(uint16_t crc, uint8_t b)
+{
+    return (crc << 8) ^ firecode_tab[(crc >> 8) ^ b];
+}
+
+__attribute__((constructor))
+static void firecode_init(void)
 {
-    int crc;
-    int gen_poly;
+    for (int b = 0; b < 256; b++) {
+        uint16_t crc = b << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ FIRECODE_POLY : (crc << 1);
+        }
+        firecode_tab[b] = crc;
+    }
+
+    for (int b = 0; b < 256; b++) {
+        uint16_t crc = firecode_tab[b];
+        for (int i = 0; i < FIRECODE_LENGTH; i++) {
+            crc = firecode_update(crc, 0);
+        }
+        firecode_out_tab[b] = crc;
+    }
+}
 
-    crc = 0x0000;
-    gen_poly = 0x782F;	// 0111 1000 0010 1111 (16, 14, 13, 12, 11, 5, 3, 2, 1, 0)
+uint16_t firecode_crc(const uint8_t* buf, size_t size)
+{
+    uint16_t crc = 0x0000;
 
     for (size_t len = 0; len < size; len++) {
-        for (int i = 0x80; i != 0; i >>= 1) {
-            if ((crc & 0x8000) != 0) {
-                crc = (crc << 1) ^ gen_poly;
-            }
-            else {
-                crc = crc << 1;
-            }
-            if ((buf[len] & i) != 0) {
-                crc ^= gen_poly;
-            }
+        crc = firecode_update(crc, buf[len]);
+    }
+
+    return crc;
+}
+
+long firecode_search(const uint8_t* buf, size_t size, size_t from)
+{
+    // Every candidate needs the two firecode bytes and the protected bytes
+    if (size < from + 2 + FIRECODE_LENGTH) {
+        return -1;
+    }
+
+    const size_t last = size - (2 + FIRECODE_LENGTH);
+
+    uint16_t crc = firecode_crc(buf + from + 2, FIRECODE_LENGTH);
+
+    for (size_t i = from; ; i++) {
+        if (crc == ((buf[i] << 8) | buf[i+1])) {
+            return i;
         }
+
+        if (i == last) {
+            break;
+        }
+
+        // Slide the window by one byte
+        crc = firecode_update(crc, buf[i + 2 + FIRECODE_LENGTH]) ^
+              firecode_out_tab[buf[i + 2]];
     }
 
-    return crc & 0xFFFF;
+    return -1;
 }
 
@@ -27,7 +27,18 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-uint16_t firecode_crc(uint8_t* buf, size_t size);
+/* Number of superframe header bytes protected by the firecode */
+#define FIRECODE_LENGTH 9
+
+uint16_t firecode_crc(const uint8_t* buf, size_t size);
+
+/* Search buf for a position i >= from where the two bytes at i are the
+ * firecode of the FIRECODE_LENGTH bytes that follow them. The CRC is
+ * updated incrementally from one position to the next.
+ *
+ * Returns the position, or -1 if there is none.
+ */
+long firecode_search(const uint8_t* buf, size_t size, size_t from);
 
 #endif
 
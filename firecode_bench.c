@@ -0,0 +1,167 @@
+/*
+    Copyright (C) 2014 Matthias P. Braendli (http://www.opendigitalradio.org)
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    firecode_bench.c
+         Compare firecode_search() with a search that computes the
+         bitwise CRC at every position, over a noisy buffer
+
+    Authors:
+         Matthias P. Braendli <matthias@mpb.li>
+         agent <agent@local>
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "firecode.h"
+
+// Size of the noisy buffer, and how often it is searched
+#define BENCH_SIZE   (1 << 20)
+#define BENCH_ROUNDS 20
+
+// A valid superframe header every BENCH_HEADER_SPACING bytes
+#define BENCH_HEADER_SPACING 720
+
+/* The firecode computed bit by bit, as etisnoop did before the table */
+static uint16_t firecode_crc_bitwise(const uint8_t* buf, size_t size)
+{
+    int crc;
+    int gen_poly;
+
+    crc = 0x0000;
+    gen_poly = 0x782F;	// 0111 1000 0010 1111 (16, 14, 13, 12, 11, 5, 3, 2, 1, 0)
+
+    for (size_t len = 0; len < size; len++) {
+        for (int i = 0x80; i != 0; i >>= 1) {
+            if ((crc & 0x8000) != 0) {
+                crc = (crc << 1) ^ gen_poly;
+            }
+            else {
+                crc = crc << 1;
+            }
+            if ((buf[len] & i) != 0) {
+                crc ^= gen_poly;
+            }
+        }
+    }
+
+    return crc & 0xFFFF;
+}
+
+/* Same contract as firecode_search(), computing the whole CRC again at
+ * every position */
+static long firecode_search_bitwise(const uint8_t* buf, size_t size,
+        size_t from)
+{
+    for (size_t i = from; i + 2 + FIRECODE_LENGTH <= size; i++) {
+        if (firecode_crc_bitwise(buf + i + 2, FIRECODE_LENGTH) ==
+                ((buf[i] << 8) | buf[i+1])) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Find all matches in buf, return how many, and their sum in *pos_sum
+ * so that both searches can be compared */
+static long count_matches(long (*search)(const uint8_t*, size_t, size_t),
+        const uint8_t* buf, size_t size, uint64_t* pos_sum)
+{
+    long matches = 0;
+    size_t from = 0;
+    long pos;
+
+    *pos_sum = 0;
+    while ((pos = search(buf, size, from)) >= 0) {
+        matches++;
+        *pos_sum += pos;
+        from = pos + 1;
+    }
+    return matches;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench(const char* name,
+        long (*search)(const uint8_t*, size_t, size_t),
+        const uint8_t* buf, size_t size, long* matches, uint64_t* pos_sum)
+{
+    double start = now();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        *matches = count_matches(search, buf, size, pos_sum);
+    }
+    double elapsed = now() - start;
+
+    const double mb = (double)size * BENCH_ROUNDS / (1024 * 1024);
+    printf("%-10s %8.3f s  %9.1f MB/s  %ld matches\n",
+            name, elapsed, mb / elapsed, *matches);
+    return elapsed;
+}
+
+int main(void)
+{
+    uint8_t* buf = (uint8_t*)malloc(BENCH_SIZE);
+    if (buf == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    // Random bytes, like a subchannel without sync
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < BENCH_SIZE; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        buf[i] = state;
+    }
+
+    // and some valid headers
+    for (size_t i = 0; i + 2 + FIRECODE_LENGTH <= BENCH_SIZE;
+            i += BENCH_HEADER_SPACING) {
+        uint16_t crc = firecode_crc(buf + i + 2, FIRECODE_LENGTH);
+        buf[i] = crc >> 8;
+        buf[i+1] = crc & 0xFF;
+    }
+
+    printf("Searching %d bytes %d times\n", BENCH_SIZE, BENCH_ROUNDS);
+
+    long matches_bitwise, matches_table;
+    uint64_t sum_bitwise, sum_table;
+    double t_bitwise = bench("bitwise", firecode_search_bitwise,
+            buf, BENCH_SIZE, &matches_bitwise, &sum_bitwise);
+    double t_table = bench("search", firecode_search,
+            buf, BENCH_SIZE, &matches_table, &sum_table);
+
+    free(buf);
+
+    if (matches_bitwise != matches_table || sum_bitwise != sum_table) {
+        printf("The searches found different positions\n");
+        return 1;
+    }
+
+    printf("firecode_search() is %.1f times faster\n", t_bitwise / t_table);
+    return 0;
+}
+
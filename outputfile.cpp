@@ -0,0 +1,412 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    outputfile.cpp
+         Buffered output files written by a background thread
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <deque>
+#include <utility>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "outputfile.h"
+
+// Number of consecutive buffers of a file given to one writev()
+#define OUTPUT_MAX_IOV 64
+
+struct output_job_t {
+    int fd;
+    uint8_t* buf;    // pool buffer, or malloc'ed if offset >= 0
+    size_t len;
+    off_t offset;    // -1 to append
+    bool* closed;    // if not NULL, close fd and set *closed
+};
+
+/* The writer thread and the pool of buffers */
+class OutputWriter
+{
+    public:
+        OutputWriter();
+        ~OutputWriter();
+
+        /* Take a buffer from the pool, blocks if all are in use */
+        uint8_t* get_buffer(void);
+
+        void submit(const output_job_t& job);
+
+        /* Wait until the writer has set *closed */
+        void wait_closed(const bool* closed);
+
+    private:
+        void run(void);
+        void write_jobs(std::deque<output_job_t>& jobs);
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::deque<output_job_t> m_jobs;
+        std::vector<uint8_t*> m_free;
+        size_t m_num_buffers;
+        bool m_running;
+        std::thread m_thread;
+};
+
+static OutputWriter& output_writer()
+{
+    static OutputWriter writer;
+    return writer;
+}
+
+OutputWriter::OutputWriter() :
+    m_num_buffers(0),
+    m_running(true)
+{
+    m_thread = std::thread(&OutputWriter::run, this);
+}
+
+OutputWriter::~OutputWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_cond.notify_all();
+    }
+    m_thread.join();
+
+    for (size_t i = 0; i < m_free.size(); i++) {
+        free(m_free[i]);
+    }
+}
+
+uint8_t* OutputWriter::get_buffer()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_free.empty() && m_num_buffers < OUTPUT_MAX_BUFFERS) {
+        void* buf = NULL;
+        if (posix_memalign(&buf, 4096, OUTPUT_BUFFER_SIZE) != 0) {
+            perror("Output buffer allocation failed");
+            abort();
+        }
+        m_num_buffers++;
+        return (uint8_t*)buf;
+    }
+
+    m_cond.wait(lock, [this] { return !m_free.empty(); });
+
+    uint8_t* buf = m_free.back();
+    m_free.pop_back();
+    return buf;
+}
+
+void OutputWriter::submit(const output_job_t& job)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(job);
+    m_cond.notify_all();
+}
+
+void OutputWriter::wait_closed(const bool* closed)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [closed] { return *closed; });
+}
+
+void OutputWriter::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_cond.wait(lock, [this] { return !m_jobs.empty() || !m_running; });
+
+        if (m_jobs.empty()) {
+            break;
+        }
+
+        // Write everything queued so far without holding the lock
+        std::deque<output_job_t> jobs;
+        jobs.swap(m_jobs);
+
+        lock.unlock();
+        write_jobs(jobs);
+        lock.lock();
+
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (jobs[i].offset >= 0) {
+                free(jobs[i].buf);
+            }
+            else if (jobs[i].buf) {
+                m_free.push_back(jobs[i].buf);
+            }
+
+            if (jobs[i].closed) {
+                *jobs[i].closed = true;
+            }
+        }
+        m_cond.notify_all();
+    }
+}
+
+static void output_error(int fd)
+{
+    fprintf(stderr, "Output write to fd %d failed: %s\n", fd, strerror(errno));
+}
+
+static void write_all(int fd, struct iovec* iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t ret = writev(fd, iov, iovcnt);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            output_error(fd);
+            return;
+        }
+
+        // Skip what has been written, in case of a short write
+        size_t done = ret;
+        while (iovcnt > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+void OutputWriter::write_jobs(std::deque<output_job_t>& jobs)
+{
+    struct iovec iov[OUTPUT_MAX_IOV];
+
+    size_t i = 0;
+    while (i < jobs.size()) {
+        const output_job_t& job = jobs[i];
+
+        if (job.offset >= 0) {
+            if (pwrite(job.fd, job.buf, job.len, job.offset) !=
+                    (ssize_t)job.len) {
+                output_error(job.fd);
+            }
+            i++;
+        }
+        else if (job.len > 0) {
+            // Gather the following buffers of the same file
+            int iovcnt = 0;
+            while (i < jobs.size() && iovcnt < OUTPUT_MAX_IOV &&
+                    jobs[i].fd == job.fd && jobs[i].offset < 0 &&
+                    jobs[i].len > 0) {
+                iov[iovcnt].iov_base = jobs[i].buf;
+                iov[iovcnt].iov_len = jobs[i].len;
+                iovcnt++;
+
+                if (jobs[i].closed) {
+                    i++;
+                    break;
+                }
+                i++;
+            }
+            write_all(job.fd, iov, iovcnt);
+        }
+        else {
+            i++;
+        }
+
+        if (jobs[i-1].closed) {
+            ::close(jobs[i-1].fd);
+        }
+    }
+}
+
+OutputFile::OutputFile() :
+    m_fd(-1),
+    m_seekable(false),
+    m_buf(NULL),
+    m_buf_len(0),
+    m_size(0)
+{
+}
+
+OutputFile::OutputFile(OutputFile&& other) :
+    m_fd(-1),
+    m_seekable(false),
+    m_buf(NULL),
+    m_buf_len(0),
+    m_size(0)
+{
+    *this = std::move(other);
+}
+
+OutputFile& OutputFile::operator=(OutputFile&& other)
+{
+    if (this != &other) {
+        close();
+
+        m_fd       = other.m_fd;
+        m_seekable = other.m_seekable;
+        m_buf      = other.m_buf;
+        m_buf_len  = other.m_buf_len;
+        m_size     = other.m_size;
+
+        other.m_fd = -1;
+        other.m_buf = NULL;
+        other.m_buf_len = 0;
+    }
+    return *this;
+}
+
+OutputFile::~OutputFile()
+{
+    close();
+}
+
+bool OutputFile::open(const std::string& filename)
+{
+    close();
+
+    m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (m_fd == -1) {
+        return false;
+    }
+
+    opened();
+    return true;
+}
+
+bool OutputFile::open_target(const std::string& target)
+{
+    if (target.compare(0, 3, "fd:") != 0) {
+        return open(target);
+    }
+
+    close();
+
+    char* end;
+    long fd = strtol(target.c_str() + 3, &end, 10);
+    if (*end != '\0' || end == target.c_str() + 3 || fd < 0 ||
+            fcntl(fd, F_GETFD) == -1) {
+        errno = EBADF;
+        return false;
+    }
+
+    m_fd = fd;
+    opened();
+    return true;
+}
+
+void OutputFile::opened()
+{
+    m_seekable = lseek(m_fd, 0, SEEK_CUR) != -1;
+    m_buf = output_writer().get_buffer();
+    m_buf_len = 0;
+    m_size = 0;
+}
+
+void OutputFile::flush()
+{
+    if (m_buf_len > 0) {
+        output_job_t job = {m_fd, m_buf, m_buf_len, -1, NULL};
+        output_writer().submit(job);
+
+        m_buf = output_writer().get_buffer();
+        m_buf_len = 0;
+    }
+}
+
+void OutputFile::write(const void* data, size_t len)
+{
+    const uint8_t* d = (const uint8_t*)data;
+
+    while (len > 0) {
+        size_t n = OUTPUT_BUFFER_SIZE - m_buf_len;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(m_buf + m_buf_len, d, n);
+        m_buf_len += n;
+        m_size += n;
+        d += n;
+        len -= n;
+
+        if (m_buf_len == OUTPUT_BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    if (!m_seekable) {
+        flush();
+    }
+}
+
+void* OutputFile::reserve(size_t len)
+{
+    if (m_buf_len + len > OUTPUT_BUFFER_SIZE) {
+        flush();
+    }
+    return m_buf + m_buf_len;
+}
+
+void OutputFile::commit(size_t len)
+{
+    m_buf_len += len;
+    m_size += len;
+
+    if (m_buf_len == OUTPUT_BUFFER_SIZE || !m_seekable) {
+        flush();
+    }
+}
+
+void OutputFile::write_at(off_t offset, const void* data, size_t len)
+{
+    flush();
+
+    output_job_t job = {m_fd, (uint8_t*)malloc(len), len, offset, NULL};
+    memcpy(job.buf, data, len);
+    output_writer().submit(job);
+}
+
+void OutputFile::close()
+{
+    if (m_fd == -1) {
+        return;
+    }
+
+    // The last buffer goes back to the pool with the close
+    bool closed = false;
+    output_job_t job = {m_fd, m_buf, m_buf_len, -1, &closed};
+    output_writer().submit(job);
+    output_writer().wait_closed(&closed);
+
+    m_fd = -1;
+    m_buf = NULL;
+    m_buf_len = 0;
+}
+
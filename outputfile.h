@@ -0,0 +1,101 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    outputfile.h
+         Buffered output files written by a background thread
+
+    Authors:
+         agent <agent@local>
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <string>
+
+#ifndef __OUTPUTFILE_H_
+#define __OUTPUTFILE_H_
+
+// Size of the buffers handed over to the writer thread
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+// Maximum number of buffers allocated for all files together. When
+// they are all waiting to be written, writing to a file blocks.
+#define OUTPUT_MAX_BUFFERS 256
+
+/* A file that is written through large buffers. Full buffers are
+ * queued to a single writer thread shared by all OutputFiles, which
+ * writes them with writev(), so that the decoders do not wait for
+ * the disk. Writes are done in the order they were queued.
+ */
+class OutputFile
+{
+    public:
+        OutputFile();
+        OutputFile(OutputFile&& other);
+        OutputFile& operator=(OutputFile&& other);
+        ~OutputFile();
+
+        /* Create or truncate the file. Returns false and sets errno
+         * on failure */
+        bool open(const std::string& filename);
+
+        /* Open an output given on the command line: "fd:N" for an
+         * already open file descriptor, which is closed by close(),
+         * anything else is a file name and can also be a FIFO */
+        bool open_target(const std::string& target);
+
+        bool is_open(void) const { return m_fd != -1; }
+
+        /* False for pipes, FIFOs and terminals. Such outputs are
+         * written out after every write() or commit(), to keep the
+         * latency low, and write_at() cannot be used on them */
+        bool is_seekable(void) const { return m_seekable; }
+
+        void write(const void* data, size_t len);
+
+        /* Return space for len bytes in the buffer, len must not be
+         * larger than OUTPUT_BUFFER_SIZE. The caller fills it and then
+         * calls commit(len) */
+        void* reserve(size_t len);
+        void commit(size_t len);
+
+        /* Overwrite len bytes at offset, after all data written
+         * so far. Used to complete a header when closing */
+        void write_at(off_t offset, const void* data, size_t len);
+
+        /* Write out everything and close the file. Blocks until done */
+        void close(void);
+
+        /* Number of bytes written to the file so far */
+        uint64_t size(void) const { return m_size; }
+
+    private:
+        OutputFile(const OutputFile& other);
+        OutputFile& operator=(const OutputFile& other);
+
+        void flush(void);
+        void opened(void);
+
+        int m_fd;
+        bool m_seekable;
+        uint8_t* m_buf;
+        size_t m_buf_len;
+        uint64_t m_size;
+};
+
+#endif
+
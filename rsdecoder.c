@@ -0,0 +1,354 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    rsdecoder.c
+         Reed-Solomon decoder for DAB+ superframes
+
+    Authors:
+         agent <agent@local>
+*/
+
+/* The syndromes are calculated for up to 16 codewords at once: the k-th
+ * bytes of consecutive codewords are adjacent in the superframe, so one
+ * row of the interleaver can be loaded into a vector, and the Horner
+ * scheme S_i = S_i * alpha^i + c_k is applied to all codewords in
+ * parallel. The multiplication by the constant alpha^i is done with two
+ * table lookups, one for each nibble (PSHUFB).
+ *
+ * In most superframes, all syndromes are zero. Only the codewords with
+ * errors go through Berlekamp-Massey, the Chien search and Forney's
+ * algorithm.
+ */
+
+#include "rsdecoder.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define RS_HAVE_SSSE3 1
+#  include <immintrin.h>
+#endif
+
+#define RS_N       120
+#define RS_NROOTS  10
+#define RS_T       (RS_NROOTS / 2)
+#define RS_POLY    0x11D
+
+// Number of codewords processed together
+#define RS_LANES   16
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+
+/* Multiplication by alpha^i, for each nibble of the other factor */
+static uint8_t rs_mul_lo[RS_NROOTS][16];
+static uint8_t rs_mul_hi[RS_NROOTS][16];
+
+#if RS_HAVE_SSSE3
+static int rs_use_ssse3;
+#endif
+
+static inline uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static inline uint8_t gf_div(uint8_t a, uint8_t b)
+{
+    if (a == 0) {
+        return 0;
+    }
+    return gf_exp[gf_log[a] + 255 - gf_log[b]];
+}
+
+__attribute__((constructor))
+static void rs_init(void)
+{
+    int x = 1;
+    for (int i = 0; i < 255; i++) {
+        gf_exp[i] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= RS_POLY;
+        }
+    }
+    for (int i = 255; i < 512; i++) {
+        gf_exp[i] = gf_exp[i - 255];
+    }
+
+    for (int i = 0; i < RS_NROOTS; i++) {
+        for (int n = 0; n < 16; n++) {
+            rs_mul_lo[i][n] = gf_mul(gf_exp[i], n);
+            rs_mul_hi[i][n] = gf_mul(gf_exp[i], n << 4);
+        }
+    }
+
+#if RS_HAVE_SSSE3
+    __builtin_cpu_init();
+    rs_use_ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+/* Calculate the syndromes of the lanes codewords starting with codeword
+ * first. synd[i][lane] receives S_i. Returns non-zero if any of them
+ * is not zero. */
+static int rs_syndromes(const uint8_t* sf, unsigned s, unsigned first,
+        unsigned lanes, uint8_t synd[RS_NROOTS][RS_LANES])
+{
+    memset(synd, 0, RS_NROOTS * RS_LANES);
+
+    for (int k = 0; k < RS_N; k++) {
+        const uint8_t* row = sf + k * s + first;
+
+        for (int i = 0; i < RS_NROOTS; i++) {
+            for (unsigned lane = 0; lane < lanes; lane++) {
+                const uint8_t v = synd[i][lane];
+                synd[i][lane] = rs_mul_lo[i][v & 0x0F] ^
+                                rs_mul_hi[i][v >> 4] ^ row[lane];
+            }
+        }
+    }
+
+    uint8_t any = 0;
+    for (int i = 0; i < RS_NROOTS; i++) {
+        for (unsigned lane = 0; lane < lanes; lane++) {
+            any |= synd[i][lane];
+        }
+    }
+    return any;
+}
+
+#if RS_HAVE_SSSE3
+__attribute__((target("ssse3")))
+static int rs_syndromes_ssse3(const uint8_t* sf, unsigned s, unsigned first,
+        unsigned lanes, uint8_t synd[RS_NROOTS][RS_LANES])
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    __m128i mul_lo[RS_NROOTS];
+    __m128i mul_hi[RS_NROOTS];
+    __m128i acc[RS_NROOTS];
+    for (int i = 0; i < RS_NROOTS; i++) {
+        mul_lo[i] = _mm_loadu_si128((const __m128i*)rs_mul_lo[i]);
+        mul_hi[i] = _mm_loadu_si128((const __m128i*)rs_mul_hi[i]);
+        acc[i] = _mm_setzero_si128();
+    }
+
+    uint8_t partial[RS_LANES] = {0};
+
+    for (int k = 0; k < RS_N; k++) {
+        const uint8_t* row = sf + k * s + first;
+
+        __m128i c;
+        if (lanes == RS_LANES) {
+            c = _mm_loadu_si128((const __m128i*)row);
+        }
+        else {
+            // The last codewords of the superframe
+            memcpy(partial, row, lanes);
+            c = _mm_loadu_si128((const __m128i*)partial);
+        }
+
+        for (int i = 0; i < RS_NROOTS; i++) {
+            const __m128i lo = _mm_and_si128(acc[i], nibble);
+            const __m128i hi = _mm_and_si128(_mm_srli_epi16(acc[i], 4), nibble);
+            acc[i] = _mm_xor_si128(
+                    _mm_xor_si128(_mm_shuffle_epi8(mul_lo[i], lo),
+                                  _mm_shuffle_epi8(mul_hi[i], hi)),
+                    c);
+        }
+    }
+
+    __m128i any = _mm_setzero_si128();
+    for (int i = 0; i < RS_NROOTS; i++) {
+        _mm_storeu_si128((__m128i*)synd[i], acc[i]);
+        any = _mm_or_si128(any, acc[i]);
+    }
+
+    return _mm_movemask_epi8(
+            _mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF;
+}
+#endif
+
+/* Correct codeword j, whose syndromes are synd[0..RS_NROOTS-1].
+ * Returns the number of corrected bytes or -1 */
+static int rs_correct_codeword(uint8_t* sf, unsigned s, unsigned j,
+        const uint8_t* synd)
+{
+    // Berlekamp-Massey: find the error locator polynomial lambda
+    uint8_t lambda[RS_NROOTS + 1] = {1};
+    uint8_t b[RS_NROOTS + 1] = {1};
+    uint8_t t[RS_NROOTS + 1];
+    int L = 0;
+    int m = 1;
+    uint8_t bb = 1;
+
+    for (int r = 0; r < RS_NROOTS; r++) {
+        uint8_t d = synd[r];
+        for (int i = 1; i <= L; i++) {
+            d ^= gf_mul(lambda[i], synd[r - i]);
+        }
+
+        if (d == 0) {
+            m++;
+            continue;
+        }
+
+        const uint8_t coef = gf_div(d, bb);
+
+        if (2 * L <= r) {
+            memcpy(t, lambda, sizeof(t));
+            for (int i = 0; i + m <= RS_NROOTS; i++) {
+                lambda[i + m] ^= gf_mul(coef, b[i]);
+            }
+            L = r + 1 - L;
+            memcpy(b, t, sizeof(b));
+            bb = d;
+            m = 1;
+        }
+        else {
+            for (int i = 0; i + m <= RS_NROOTS; i++) {
+                lambda[i + m] ^= gf_mul(coef, b[i]);
+            }
+            m++;
+        }
+    }
+
+    if (L > RS_T) {
+        return -1;
+    }
+
+    // Error evaluator omega = synd * lambda mod x^RS_NROOTS
+    uint8_t omega[RS_NROOTS] = {0};
+    for (int i = 0; i < L; i++) {
+        for (int n = 0; n <= i; n++) {
+            omega[i] ^= gf_mul(lambda[n], synd[i - n]);
+        }
+    }
+
+    // Chien search over the positions of the shortened code, and Forney
+    int err_pos[RS_T];
+    uint8_t err_val[RS_T];
+    int num_errors = 0;
+
+    for (int k = 0; k < RS_N; k++) {
+        // Byte k is the coefficient of x^(RS_N-1-k)
+        const int x_log = RS_N - 1 - k;
+        const int xinv_log = (255 - x_log) % 255;
+
+        uint8_t lambda_val = 0;
+        uint8_t lambda_deriv = 0;
+        for (int i = 0; i <= L; i++) {
+            const uint8_t term = lambda[i] ?
+                gf_exp[gf_log[lambda[i]] + (xinv_log * i) % 255] : 0;
+            lambda_val ^= term;
+            if (i & 1) {
+                // The derivative is the odd terms, divided by x
+                lambda_deriv ^= term;
+            }
+        }
+
+        if (lambda_val != 0) {
+            continue;
+        }
+
+        if (num_errors == RS_T) {
+            return -1;
+        }
+
+        uint8_t omega_val = 0;
+        for (int i = 0; i < L; i++) {
+            if (omega[i]) {
+                omega_val ^= gf_exp[gf_log[omega[i]] + (xinv_log * i) % 255];
+            }
+        }
+
+        // lambda_deriv is lambda'(X^-1) * X^-1, which makes the
+        // X * omega(X^-1) / lambda'(X^-1) of Forney's formula
+        // omega(X^-1) / lambda_deriv
+        if (lambda_deriv == 0) {
+            return -1;
+        }
+
+        err_pos[num_errors] = k;
+        err_val[num_errors] = gf_div(omega_val, lambda_deriv);
+        num_errors++;
+    }
+
+    if (num_errors != L) {
+        // Some roots are in the part removed by shortening
+        return -1;
+    }
+
+    for (int n = 0; n < num_errors; n++) {
+        sf[j + s * err_pos[n]] ^= err_val[n];
+    }
+
+    return num_errors;
+}
+
+int rs_decode_superframe(uint8_t* superframe, unsigned subchannel_index)
+{
+    const unsigned s = subchannel_index;
+    uint8_t synd[RS_NROOTS][RS_LANES];
+    int corrected = 0;
+    int uncorrectable = 0;
+
+    for (unsigned first = 0; first < s; first += RS_LANES) {
+        const unsigned lanes = (s - first < RS_LANES) ? s - first : RS_LANES;
+
+        int any;
+#if RS_HAVE_SSSE3
+        if (rs_use_ssse3) {
+            any = rs_syndromes_ssse3(superframe, s, first, lanes, synd);
+        }
+        else
+#endif
+        {
+            any = rs_syndromes(superframe, s, first, lanes, synd);
+        }
+
+        if (!any) {
+            continue;
+        }
+
+        for (unsigned lane = 0; lane < lanes; lane++) {
+            uint8_t cw_synd[RS_NROOTS];
+            uint8_t nonzero = 0;
+            for (int i = 0; i < RS_NROOTS; i++) {
+                cw_synd[i] = synd[i][lane];
+                nonzero |= cw_synd[i];
+            }
+
+            if (nonzero) {
+                int ret = rs_correct_codeword(superframe, s,
+                        first + lane, cw_synd);
+                if (ret < 0) {
+                    uncorrectable = 1;
+                }
+                else {
+                    corrected += ret;
+                }
+            }
+        }
+    }
+
+    return uncorrectable ? -1 : corrected;
+}
+
@@ -0,0 +1,46 @@
+/*
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    rsdecoder.h
+         Reed-Solomon decoder for DAB+ superframes
+
+    Authors:
+         agent <agent@local>
+*/
+
+#ifndef _RSDECODER_H_
+#define _RSDECODER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Correct the DAB+ superframe of subchannel_index*120 bytes in place,
+ * according to ETSI TS 102 563 Clause 6.
+ *
+ * The superframe is made of subchannel_index virtually interleaved
+ * RS(120,110) codewords: codeword j consists of the bytes j +
+ * subchannel_index*k, k=0..119, the last ten of which are the parity.
+ * The code is shortened from RS(255,245) over GF(2^8) with the field
+ * polynomial x^8+x^4+x^3+x^2+1 and the generator roots alpha^0 to
+ * alpha^9, and corrects up to five bytes per codeword.
+ *
+ * Returns the number of corrected bytes, or -1 if at least one codeword
+ * could not be corrected.
+ */
+int rs_decode_superframe(uint8_t* superframe, unsigned subchannel_index);
+
+#endif
+
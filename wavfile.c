@@ -27,56 +27,31 @@ struct wavfile_header {
 	int	data_length;
 };
 
-FILE * wavfile_open( const char *filename, int rate )
+void wavfile_header( char header[WAVFILE_HEADER_SIZE], int rate, int data_length )
 {
-	struct wavfile_header header;
+	struct wavfile_header h;
 
 	int samples_per_second = rate;
 	int bits_per_sample = 16;
 
-	strncpy(header.riff_tag,"RIFF",4);
-	strncpy(header.wave_tag,"WAVE",4);
-	strncpy(header.fmt_tag,"fmt ",4);
-	strncpy(header.data_tag,"data",4);
-
-	header.riff_length = 0;
-	header.fmt_length = 16;
-	header.audio_format = 1;
-	header.num_channels = 2;
-	header.sample_rate = samples_per_second;
-	header.byte_rate = samples_per_second*(bits_per_sample/8);
-	header.block_align = bits_per_sample/8;
-	header.bits_per_sample = bits_per_sample;
-	header.data_length = 0;
-
-	FILE * file = fopen(filename,"w+");
-	if(!file) return 0;
-
-	fwrite(&header,sizeof(header),1,file);
-
-	fflush(file);
-
-	return file;
-
-}
-
-void wavfile_write( FILE *file, short data[], int length )
-{
-	fwrite(data,sizeof(short),length,file);
-}
-
-void wavfile_close( FILE *file )
-{
-	int file_length = ftell(file);
-
-	int data_length = file_length - sizeof(struct wavfile_header);
-	fseek(file,sizeof(struct wavfile_header) - sizeof(int),SEEK_SET);
-	fwrite(&data_length,sizeof(data_length),1,file);
-
-	int riff_length = file_length - 8;
-	fseek(file,4,SEEK_SET);
-	fwrite(&riff_length,sizeof(riff_length),1,file);
-
-	fclose(file);
+	strncpy(h.riff_tag,"RIFF",4);
+	strncpy(h.wave_tag,"WAVE",4);
+	strncpy(h.fmt_tag,"fmt ",4);
+	strncpy(h.data_tag,"data",4);
+
+	if(data_length==WAVFILE_UNKNOWN_LENGTH) {
+		h.riff_length = WAVFILE_UNKNOWN_LENGTH;
+	} else {
+		h.riff_length = data_length + sizeof(h) - 8;
+	}
+	h.fmt_length = 16;
+	h.audio_format = 1;
+	h.num_channels = 2;
+	h.sample_rate = samples_per_second;
+	h.byte_rate = samples_per_second*(bits_per_sample/8);
+	h.block_align = bits_per_sample/8;
+	h.bits_per_sample = bits_per_sample;
+	h.data_length = data_length;
+
+	memcpy(header,&h,sizeof(h));
 }
-
@@ -8,11 +8,17 @@ http://www.nd.edu/~dthain/courses/cse20211/fall2013/wavfile
 #ifndef WAVFILE_H
 #define WAVFILE_H
 
-#include <stdio.h>
 #include <inttypes.h>
 
-FILE * wavfile_open( const char *filename, int rate );
-void wavfile_write( FILE *file, short data[], int length );
-void wavfile_close( FILE * file );
+#define WAVFILE_HEADER_SIZE 44
+
+/* Length to use when writing to a pipe, where the header cannot be
+   completed at the end. Readers then take everything up to the end
+   of the stream as samples. */
+#define WAVFILE_UNKNOWN_LENGTH -1
+
+/* Fill header with the header of a 16-bit stereo file containing
+   data_length bytes of samples. The samples follow the header. */
+void wavfile_header( char header[WAVFILE_HEADER_SIZE], int rate, int data_length );
 
 #endif